@@ -0,0 +1,106 @@
+/*
+ * bench-say.c
+ *   - Cost of a filtered say(DEBUG, ...) per tablet event
+ *
+ * tablet_tool_axis_notify() issues three say(DEBUG) calls per pen event. This
+ * compares the old say(), which formatted into a buffer before wlroots dropped
+ * the message, with the say() macro from globals.h, which tests g_say_level
+ * before the arguments are evaluated. A 200 Hz tablet is simulated for
+ * SECONDS of pen input.
+ *
+ * Usage: bench-say [seconds]    (built with meson compile bench-say)
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+enum MessageType { DEBUG, INFO, WARNING, ERROR, NMSG };
+
+#define TABLET_HZ 200
+
+int g_say_level = NMSG;                // default: nothing below -d/-i is printed
+static int wlr_level = 0;              // WLR_SILENT
+
+static uint64_t
+now_ns()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//--- old path: format first, let the logger drop it ---------------------
+__attribute__((noinline)) static void
+wlr_log_stub(int importance, const char *fmt, ...)
+{
+   if(importance > wlr_level) return;
+   va_list args;
+   va_start(args, fmt);
+   vfprintf(stderr, fmt, args);
+   va_end(args);
+}
+
+__attribute__((noinline)) static void
+say_old(int level, const char *message, ...)
+{
+   char buffer[256];
+   va_list args;
+   va_start(args, message);
+   vsnprintf(buffer, 256, message, args);
+   va_end(args);
+
+   wlr_log_stub(level==DEBUG ? 3 : 2, "[%d]: %s", level, buffer);
+}
+
+//--- new path: the macro from globals.h ---------------------------------
+__attribute__((noinline)) void
+say_log(int level, const char *message, ...)
+{
+   va_list args;
+   va_start(args, message);
+   vfprintf(stderr, message, args);
+   va_end(args);
+}
+
+#define SAY_COMPILED(L)    1
+#define say(L, ...) \
+   do { if(SAY_COMPILED(L) && ((L) >= g_say_level || (L) == ERROR)) say_log((L), __VA_ARGS__); } while(0)
+
+//------------------------------------------------------------------------
+static volatile double sink;
+
+int
+main(int argc, char **argv)
+{
+   int seconds = argc > 1 ? atoi(argv[1]) : 60;
+   long events = (long)seconds * TABLET_HZ;
+   volatile double x = 0.25, y = 0.75;
+
+   uint64_t t0 = now_ns();
+   for(long i=0; i<events; i++) {
+      say_old(DEBUG, "cursor_tool_axis_notify");
+      say_old(DEBUG, "ev->x = %f / ev->y = %f", x, y);
+      say_old(DEBUG, "xx = %f / yy = %f", x * 1920, y * 1080);
+      sink = x;
+   }
+   uint64_t t1 = now_ns();
+   for(long i=0; i<events; i++) {
+      say(DEBUG, "cursor_tool_axis_notify");
+      say(DEBUG, "ev->x = %f / ev->y = %f", x, y);
+      say(DEBUG, "xx = %f / yy = %f", x * 1920, y * 1080);
+      sink = x;
+   }
+   uint64_t t2 = now_ns();
+
+   double old_ns = (double)(t1 - t0) / events, new_ns = (double)(t2 - t1) / events;
+   printf("%ld pen events (%d s at %d Hz), 3 say(DEBUG) each, level filtered\n", events, seconds, TABLET_HZ);
+   printf("  format then drop (old say):   %8.1f ns/event  %6.3f ms per second of pen input\n",
+         old_ns, old_ns * TABLET_HZ / 1e6);
+   printf("  level check first (say()):    %8.1f ns/event  %6.3f ms per second of pen input\n",
+         new_ns, new_ns * TABLET_HZ / 1e6);
+   printf("  -Ddebug_log=disabled removes the DEBUG call sites: 0 ns/event\n");
+   return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * bench-tagset.c
+ *   - Cost of a tag switch against the number of tags and windows
+ *
+ * A tag switch sets the output's visible tags and then checks every client
+ * with tagset_intersects(), as arrange_output() does. Clients get a random tag
+ * below n_tags. The time per switch follows the window count. Up to 64 tags it
+ * does not depend on n_tags (inline word); above that each check also scans
+ * the extension words up to the visible tag, n_tags/64 at most.
+ *
+ * Usage: bench-tagset    (built with meson compile bench-tagset)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tagset.h"
+
+#define SWITCHES 20000
+
+static uint64_t
+now_ns()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static double
+bench(int n_tags, int n_clients)
+{
+   struct tagset *clients = calloc(n_clients, sizeof(struct tagset));
+   struct tagset visible = {0};
+   unsigned int seed = 1;
+
+   for(int i=0; i<n_clients; i++) {
+      seed = seed * 1103515245 + 12345;
+      tagset_single(&clients[i], (seed >> 8) % n_tags);
+   }
+
+   volatile int shown = 0;
+   uint64_t t0 = now_ns();
+   for(int s=0; s<SWITCHES; s++) {
+      tagset_single(&visible, s % n_tags);
+      int n = 0;
+      for(int i=0; i<n_clients; i++)
+         n += tagset_intersects(&clients[i], &visible);
+      shown = n;
+   }
+   uint64_t t1 = now_ns();
+   (void)shown;
+
+   for(int i=0; i<n_clients; i++) tagset_finish(&clients[i]);
+   tagset_finish(&visible);
+   free(clients);
+   return (double)(t1 - t0) / SWITCHES;
+}
+
+int
+main()
+{
+   const int tags[] = { 9, 32, 64, 256, 1024 };
+   const int windows[] = { 10, 100, 1000 };
+
+   printf("ns per tag switch (%d switches each)\n%8s", SWITCHES, "n_tags");
+   for(unsigned int w=0; w<sizeof windows / sizeof windows[0]; w++)
+      printf(" %9d win", windows[w]);
+   printf("\n");
+
+   for(unsigned int t=0; t<sizeof tags / sizeof tags[0]; t++) {
+      printf("%8d", tags[t]);
+      for(unsigned int w=0; w<sizeof windows / sizeof windows[0]; w++)
+         printf(" %13.1f", bench(tags[t], windows[w]));
+      printf("\n");
+   }
+   return 0;
+}
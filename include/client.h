@@ -36,7 +36,9 @@ struct simple_client {
    struct wl_listener set_title;
 #endif
 
-   uint32_t tag;
+   struct tagset tag;
+   pid_t pid;        // cached by get_client_pid()
+   uint32_t acked_serial;
    bool fixed;
    bool urgent;
    bool fullscreen;
@@ -49,6 +51,19 @@ struct simple_client {
 
    bool resize_requested;
    bool destroy_requested;
+
+   // launch latency (launch.c): first commit, map and frame, 0 until then
+   struct launch *launch;
+   uint64_t commit_ns, map_ns, frame_ns;
+   bool frame_pending;
+
+#if XWAYLAND
+   // ConfigureRequests of one loop iteration are merged and answered once
+   struct wl_event_source *configure_idle;
+   struct wlr_box configure_request;
+   struct wlr_box configure_sent;      // last geometry sent to the X client
+   uint32_t configure_requests, configures_sent, configures_skipped;
+#endif
 };
    
 //--- action calls
@@ -62,8 +77,10 @@ void tileClient(struct simple_client*, enum Direction);
 void maximizeClient(struct simple_client*, int);
 
 char * get_client_title(struct simple_client*);
+pid_t get_client_pid(struct simple_client*);
 char * get_client_appid(struct simple_client*);
 struct simple_client* get_top_client_from_output(struct simple_output*, bool);
+bool is_client_tag_visible(struct simple_client*);
 int get_client_at(double, double, struct simple_client**, struct wlr_surface**, double*, double*);
 int get_client_from_surface(struct wlr_surface*, struct simple_client**, struct simple_layer_surface**);
 void focus_client(struct simple_client*, bool);
@@ -75,7 +92,8 @@ void set_client_border_colour(struct simple_client*, int);
 void update_border_geometry(struct simple_client*);
 
 void xdg_new_toplevel_notify(struct wl_listener*, void*);
-void xdg_new_popup_notify(struct wl_listener*, void*);
+
+void client_report(FILE*);
 
 void xwl_new_surface_notify(struct wl_listener*, void *);
 void xwl_ready_notify(struct wl_listener*, void *);
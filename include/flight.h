@@ -0,0 +1,54 @@
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include <stdint.h>
+
+// Crash flight recorder: the last FLIGHT_RING_SIZE compositor events, always on.
+// The ring is written to $XDG_RUNTIME_DIR/simplewc-<pid>.flight when simplewc
+// crashes (SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL), on say(ERROR) and on the
+// flight_dump IPC action. Decode it with tools/simplewc-flight.
+#define FLIGHT_MAGIC       "SWCFLT2"     // 2: FL_KEY holds the binding, not the keycode
+#define FLIGHT_RING_SIZE   (1 << 13)
+
+enum FlightType {
+   FL_NONE,
+   FL_KEY,              // a: key function + 1 of a binding (0: none), b: state; focus: last FL_FOCUS
+   FL_BUTTON,           // a: button, b: state
+   FL_FOCUS,            // id: pid
+   FL_MAP,              // id: pid, a: client type
+   FL_UNMAP,            // id: pid
+   FL_CONFIGURE,        // id: pid, a: serial, b: width<<16 | height
+   FL_COMMIT,           // id: pid, a: acked configure serial
+   FL_OUTPUT_ADD,       // name: output
+   FL_OUTPUT_REMOVE,    // name: output
+   FL_OUTPUT_LAYOUT,    // name: output, a: width<<16 | height, b: x<<16 | y
+   FL_IPC,              // name: request, a/b: request arguments
+   FL_ERROR,            // say(ERROR)
+   FL_SIGNAL,           // a: signal number, last record of a crash dump
+   FL_NTYPES
+};
+
+struct flight_record {
+   uint64_t ts;         // ns, CLOCK_MONOTONIC
+   uint16_t type;
+   uint16_t pad;
+   uint32_t id;
+   uint32_t a, b;
+   char name[8];        // not NUL-terminated when full
+};
+
+// file layout: header, then n_records records, oldest first
+struct flight_header {
+   char magic[8];
+   uint32_t record_size;
+   uint32_t n_records;
+   uint64_t dump_ts;    // ns, CLOCK_MONOTONIC
+   int32_t pid;
+   int32_t signal;      // 0 when not dumped from a signal handler
+};
+
+void flight_init();
+void flight_record(int, uint32_t, uint32_t, uint32_t, const char*);
+void flight_dump(int);
+
+#endif
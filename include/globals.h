@@ -9,6 +9,13 @@
 #include <wlr/backend/session.h>
 #include <xkbcommon/xkbcommon.h>
 
+#include "tagset.h"
+#include "profile.h"
+#include "trace.h"
+#include "probes.h"
+#include "flight.h"
+#include "watchdog.h"
+
 #define XDG_SHELL_VERSION (6)
 #define LAYER_SHELL_VERSION (4)
 #define COMPOSITOR_VERSION (5)
@@ -16,15 +23,21 @@
 #define PRESENTATION_VERSION (2)
 #define DWL_IPC_VERSION (2)
 #define EXT_FOREIGN_TOPLEVEL_LIST_VERSION (1)
+#define TEARING_CONTROL_VERSION (1)
 
 #define N_LAYER_SHELL_LAYERS 4
 
 //--- macros -----
+#if defined(PROFILING) || defined(TRACING)
+#define LISTEN(E, L, H)    ({ static struct profile_site _site = { .name = #H, .handler = (H) }; \
+                              profile_listen((E), (L), &_site); })
+#else
 #define LISTEN(E, L, H)    wl_signal_add((E), ((L)->notify = (H), (L)))
+#endif
 #define LENGTH(X)          (sizeof X / sizeof X[0])
-#define TAGMASK(T)         (1 << (T))
 #define MIN(A, B)          ((A)<(B) ? (A) : (B))
 #define MAX(A, B)          ((A)>(B) ? (A) : (B))
+#define XWL_IDLE_EXIT_MIN  10    // s, wlroots restarts Xwayland only after 5 s of uptime
 
 //--- enums -----
 enum BorderColours   { FOCUSED, UNFOCUSED, URGENT, MARKED, FIXED, OUTLINE, NBORDERCOL };
@@ -40,6 +53,10 @@ enum NodeDescriptorType { NODE_CLIENT, NODE_XDG_POPUP, NODE_LAYER_SURFACE, NODE_
 enum Direction          { LEFT, RIGHT, UP, DOWN };
 enum FocusType          { NONE=0, SLOPPY, RAISE };
 enum NewClientPlacement { UNDER_MOUSE=0, CENTERED, HYBRID };
+enum OutputPowerState  { POWER_ON=0, POWER_OFF };
+enum AdaptiveSync      { VRR_OFF=0, VRR_ON, VRR_FULLSCREEN };
+enum WallpaperMode     { WP_FILL=0, WP_FIT, WP_CENTER, WP_STRETCH, WP_TILE };
+enum XwaylandMode      { XWL_LAZY=0, XWL_EAGER, XWL_IDLE_EXIT };
 #ifdef XWAYLAND
 enum NetAtoms  {NetWMWindowTypeDialog, NetWMWindowTypeSplash, NetWMWindowTypeToolbar, NetWMWindowTypeUtility, NetLast };
 #endif
@@ -56,6 +73,8 @@ struct simple_config {
    bool touchpad_tap_click;
 
    float background_colour[4];
+   char wallpaper[128];
+   int wallpaper_mode;
    float border_colour[NBORDERCOL][4];
 
    int tablet_rotation;
@@ -64,11 +83,25 @@ struct simple_config {
 
    int new_client_placement;
 
+   int adaptive_sync;
+   struct wl_list output_rules;
+   struct wl_list output_profiles;
+   struct wl_list tearing_rules;
+
    char autostart_script[64];
 
+   char log_file[128];
+   int log_file_max_size;  // KiB, rotated beyond that
+
+   int watchdog_threshold; // ms, 0 disables the stall watchdog
+   bool watchdog_backtrace;
+
    char xkb_layout[32];
    char xkb_options[32];
 
+   int xwayland_mode;
+   int xwayland_idle_exit; // s, XWL_IDLE_EXIT only
+
    struct wl_list key_bindings;
    struct wl_list mouse_bindings;
 };
@@ -91,6 +124,41 @@ struct mousemap {
    struct wl_list link;
 };
 
+struct output_rule {
+   char name[32];
+   int adaptive_sync;
+
+   struct wl_list link;
+};
+
+struct output_profile_entry {
+   char match[96];      // connector name or "make:model:serial" glob
+   bool enabled;
+   int width, height;
+   int refresh;         // mHz, 0 = any
+   bool has_position;
+   int x, y;
+   float scale;         // 0 = unset
+   int transform;       // wl_output_transform, -1 = unset
+   int adaptive_sync;   // -1 = unset
+   bool used;
+
+   struct wl_list link;
+};
+
+struct output_profile {
+   char name[32];
+   struct wl_list entries;
+
+   struct wl_list link;
+};
+
+struct tearing_rule {
+   char app_id[64];
+
+   struct wl_list link;
+};
+
 //--- global variables -----
 extern struct simple_server* g_server;
 extern struct wlr_session* g_session;
@@ -98,11 +166,37 @@ extern struct simple_config* g_config;
 
 //--- functions in config.c -----
 void readConfiguration(char*);
+void freeConfiguration();
+int parse_adaptive_sync(const char*);
 //void reloadConfiguration();
 
 //--- functions in main.c -----
-void say(int, const char*, ...);
-void spawn(char*);
+// say() checks the level before the call, so filtered messages cost one compare
+// and their arguments are never evaluated. ERROR always goes through: it exits.
+// With -DSAY_NO_DEBUG (meson -Ddebug_log) DEBUG call sites are compiled out.
+extern int g_say_level;
+void say_log(int, const char*, ...);
+#ifdef SAY_NO_DEBUG
+#define SAY_COMPILED(L)    ((L) != DEBUG)
+#else
+#define SAY_COMPILED(L)    1
+#endif
+#define say(L, ...) \
+   do { if(SAY_COMPILED(L) && ((L) >= g_say_level || (L) == ERROR)) say_log((L), __VA_ARGS__); } while(0)
 void send_signal(int);
 
+//--- functions in spawn.c -----
+// a child started with spawn(), until it is reaped
+struct simple_child {
+   struct wl_list link;
+   pid_t pid;
+   char *cmd;
+   uint64_t start;         // ns, CLOCK_MONOTONIC
+};
+
+pid_t spawn(const char*);
+struct simple_child* spawn_find(pid_t);
+void spawn_init();
+void spawn_finish();
+
 #endif
@@ -43,5 +43,6 @@ struct simple_tablet_tool {
 void input_focus_surface(struct wlr_surface*);
 
 void input_init();
+void input_finish();
 
 #endif
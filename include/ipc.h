@@ -11,4 +11,6 @@ void ipc_manager_bind(struct wl_client*, void*, uint32_t, uint32_t);
 
 void ipc_output_printstatus(struct simple_output*);
 
+void ipc_report(const char*);
+
 #endif
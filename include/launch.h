@@ -0,0 +1,25 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+// Launch latency: every spawn() is followed until its first window has been
+// committed, mapped and drawn. Clients are matched by pid (or a spawned parent
+// pid) and by the xdg-activation token handed to the child.
+struct launch;
+struct simple_client;
+struct simple_output;
+struct wlr_xdg_activation_token_v1;
+
+struct launch* launch_begin(const char*);
+const char* launch_token(struct launch*);
+void launch_started(struct launch*, pid_t);
+
+void launch_client_commit(struct simple_client*);
+void launch_client_map(struct simple_client*);
+void launch_client_unmap(struct simple_client*);
+void launch_activate(struct wlr_xdg_activation_token_v1*, struct simple_client*);
+void launch_output_frame(struct simple_output*);
+
+void launch_report(FILE*);
+void launch_finish();
+
+#endif
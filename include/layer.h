@@ -19,11 +19,15 @@ struct simple_layer_surface {
 
    bool mapped;
 
+   // layout-relevant state of the last commit that was arranged
+   struct wlr_layer_surface_v1_state last_state;
+
    // geometry of the wlr_surface within the view as currently displayed
    struct wlr_box geom;
 };
 
 void arrange_layers(struct simple_output*);
+void schedule_arrange_layers(struct simple_output*);
 void layer_new_surface_notify(struct wl_listener*, void*);
 
 #endif
@@ -0,0 +1,11 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdarg.h>
+
+void log_init(int);
+void log_finish();
+void log_vsay(int, const char*, va_list);
+void log_report(FILE*);
+
+#endif
@@ -1,23 +1,50 @@
 #ifndef OUTPUT_H
 #define OUTPUT_H
 
+struct frame_stats {
+   uint64_t frames;
+   struct timespec last;
+
+   // interval between consecutive frames in ns
+   int64_t interval_last;
+   int64_t interval_min;
+   int64_t interval_max;
+   int64_t interval_avg;
+};
+
 struct simple_output {
    struct wl_list link;
    struct wlr_output *wlr_output;
 
    struct wl_list layer_shells[N_LAYER_SHELL_LAYERS];
+   struct wl_event_source *arrange_layers_idle;
 
    struct wl_list ipc_outputs; // ipc addition
 
    struct wlr_scene_rect *fullscreen_bg;
 
+   // wallpaper (LyrBg), the buffer is shared with outputs of the same size
+   struct wlr_scene_buffer *wallpaper;
+   struct wallpaper_size *wallpaper_size;
+
    // tags
-   int fixed_tag;
-   //unsigned int current_tag;
-   //unsigned int visible_tags;
+   struct tagset fixed_tag;   // empty unless the output is fixed
+   struct tagset current_tag;
+   struct tagset visible_tags;
 
    struct simple_outline *outline;
 
+   // power state (wlr_output_power_management_v1)
+   enum OutputPowerState power_state;
+
+   // set once the first configuration (profile or defaults) was committed
+   bool configured;
+   struct output_profile_entry *profile_entry;
+
+   // adaptive sync policy and frame statistics
+   enum AdaptiveSync adaptive_sync;
+   struct frame_stats stats;
+
    struct wl_listener frame;
    struct wl_listener request_state;
    struct wl_listener destroy;
@@ -32,10 +59,32 @@ struct simple_output {
 void new_output_notify(struct wl_listener *, void *); 
 void output_layout_change_notify(struct wl_listener *, void *); 
 
+void schedule_output_configure();
+void output_configure_pending();
+void schedule_output_relayout();
+void output_relayout_flush();
+
+struct wlr_backend_output_state;
+struct wlr_output_configuration_v1;
+bool output_commit_states(struct wlr_backend_output_state*, size_t, bool);
+void output_manager_apply(struct wlr_output_configuration_v1*, bool);
+
 void toggleFixedTag();
 
 struct simple_output* get_output_at(double, double);
 
+const struct tagset* output_visible_tags(struct simple_output*);
+void arrange_output(struct simple_output*);
 void arrange_outputs();
 
+void output_set_power(struct simple_output*, enum OutputPowerState);
+void output_resume_frames();
+
+void setOutputAdaptiveSync(const char*);
+void output_update_adaptive_sync(struct simple_output*);
+void output_report_frames(FILE*);
+
+bool tearing_allowed_for(const char*, bool, bool);
+bool output_allow_tearing(struct simple_output*);
+
 #endif
@@ -0,0 +1,36 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Typed object pools. Objects are carved from slabs of about 4 KiB and freed
+// objects go onto the pool's free list, so window, popup and layer surface
+// churn reuses the same memory instead of fragmenting the heap. Slabs are only
+// released by pool_finish(). Pools are used from the event loop only.
+//
+// Every pool counts live, peak and total objects ("report pools" via IPC), so
+// a leak shows up as a live count that never goes down. With meson
+// -Dpool_debug=true freed objects are poisoned and checked when reused.
+struct pool {
+   const char *name;
+   size_t size;
+
+   struct pool_slab *slabs;
+   void *free;                // free objects, linked through their first word
+   bool registered;
+   struct pool *next;         // all pools in use, for the report
+
+   uint64_t live, peak, total, slab_count;
+};
+
+#define POOL(VAR, TYPE) \
+   static struct pool VAR = { .name = #TYPE, .size = sizeof(struct TYPE) }
+
+void* pool_alloc(struct pool*);  // zeroed, like calloc
+void pool_free(struct pool*, void*);
+void pool_report(FILE*);
+void pool_finish();
+
+#endif
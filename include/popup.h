@@ -0,0 +1,25 @@
+#ifndef POPUP_H
+#define POPUP_H
+
+// An xdg popup of a toplevel or a layer surface, possibly nested in another
+// popup. The root it is placed against is resolved once on the initial commit.
+struct simple_popup {
+   struct wl_list link;
+   struct wlr_xdg_popup *xdg_popup;
+   struct wlr_scene_tree *scene_tree;   // NULL until the initial commit
+
+   struct simple_client *client;
+   struct simple_layer_surface *lsurface;
+
+   struct wl_listener commit;
+   struct wl_listener reposition;
+   struct wl_listener destroy;
+};
+
+void popup_init();
+void popup_unconstrain_children(struct simple_client*, struct simple_layer_surface*);
+void popup_owner_destroy(struct simple_client*, struct simple_layer_surface*);
+
+void xdg_new_popup_notify(struct wl_listener*, void*);
+
+#endif
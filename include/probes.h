@@ -0,0 +1,35 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// USDT probes (provider "simplewc"), built with meson -Dusdt=enabled.
+// List them with
+//    bpftrace -l 'usdt:/path/to/simplewc:simplewc:*'
+// Example scripts are in contrib/bpftrace.
+//
+// Every probe has a semaphore that the tracer increments while it is attached
+// (bpftrace -p <pid>). PROBE() tests it first, so without a tracer neither the
+// probe nor its arguments are evaluated. Arguments that take more than a load
+// should be computed under PROBE_ENABLED(). A new probe is added to PROBE_LIST.
+#ifdef HAVE_USDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define PROBE_LIST(X) \
+   X(key_dispatch) X(motion) \
+   X(client_configure) X(client_commit) X(client_map) X(client_unmap) \
+   X(frame_start) X(frame_end) X(layer_arrange) X(ipc_action) X(ipc_send)
+
+#define PROBE_SEMAPHORE_DECLARE(N)  extern unsigned short simplewc_##N##_semaphore;
+#define PROBE_SEMAPHORE_DEFINE(N) \
+   __extension__ unsigned short simplewc_##N##_semaphore __attribute__((unused, section(".probes")));
+PROBE_LIST(PROBE_SEMAPHORE_DECLARE)
+
+#define PROBE_ENABLED(N)   __builtin_expect(simplewc_##N##_semaphore, 0)
+#define PROBE(N, ...) \
+   do { if(PROBE_ENABLED(N)) STAP_PROBEV(simplewc, N, ##__VA_ARGS__); } while(0)
+#else
+#define PROBE_ENABLED(N)   0
+#define PROBE(N, ...)      do {} while(0)
+#endif
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#define PROFILE_BUCKETS 32
+
+// one per LISTEN() call site, see the LISTEN macro in globals.h
+struct profile_site {
+   const char *name;
+   wl_notify_func_t handler;
+
+   uint64_t calls;
+   uint64_t total_ns;
+   uint64_t max_ns;
+   uint64_t hist[PROFILE_BUCKETS]; // hist[i]: calls taking [2^(i-1), 2^i) ns
+
+   bool registered;
+   struct profile_site *next;
+};
+
+void profile_listen(struct wl_signal*, struct wl_listener*, struct profile_site*);
+void profile_report(FILE*);
+void profile_reset();
+int profile_signal_notify(int, void*);
+
+#endif
@@ -19,10 +19,6 @@ struct simple_server {
    struct wlr_scene_tree *layer_tree[NLayers];
    struct wlr_scene_output_layout *scene_output_layout;
 
-   // tags
-   unsigned int current_tag;
-   unsigned int visible_tags;
-
    // output and decoration manager
    struct wl_list outputs;
    struct simple_output* cur_output;
@@ -33,6 +29,9 @@ struct simple_server {
    struct wlr_output_manager_v1 *output_manager;
    struct wl_listener output_manager_apply;
    struct wl_listener output_manager_test;
+   bool output_configure_requested;
+   struct wl_event_source *output_relayout_timer;
+   bool output_relayout_pending;
 
    struct wlr_xdg_decoration_manager_v1 *xdg_decoration_manager;
    struct wl_listener new_decoration;
@@ -50,10 +49,13 @@ struct simple_server {
    struct wl_listener xdg_new_popup;
 #if XWAYLAND
    struct wlr_xwayland *xwayland;
+   struct wlr_xwayland_server *xwayland_server;
    struct wl_listener xwl_new_surface;
    struct wl_listener xwl_ready;
 
    xcb_atom_t netatom[NetLast];
+   bool netatom_ready;        // interned on the worker pool after each Xwayland start
+   unsigned int netatom_generation;
 #endif
 
    struct wl_list layer_shells;
@@ -117,6 +119,9 @@ struct simple_server {
    struct wlr_output_power_manager_v1 *output_power_manager;
    struct wl_listener output_pm_set_mode;
 
+   // tearing control
+   struct wlr_tearing_control_manager_v1 *tearing_control_manager;
+
    // background layer
    struct wlr_scene_rect *root_bg;
 
@@ -0,0 +1,168 @@
+#ifndef TAGSET_H
+#define TAGSET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A set of tags. The first 64 tags live inline in 'word', which covers every
+// normal setup without touching the heap. Tags 64 and above go into 'ext', which
+// is allocated on demand. The sets used in visibility checks rarely hold more than
+// a tag or two, so tagset_intersects() usually answers from 'word' alone.
+struct tagset {
+   uint64_t word;          // tags 0-63
+   uint64_t *ext;          // tags 64 and above, NULL when unused
+   unsigned int n_ext;     // words allocated in ext
+};
+
+#define TAGSET_WORD(T)     ((T)/64 - 1)
+#define TAGSET_BIT(T)      ((uint64_t)1 << ((T) % 64))
+
+static inline void
+tagset_finish(struct tagset *ts)
+{
+   free(ts->ext);
+   memset(ts, 0, sizeof(*ts));
+}
+
+static inline void
+tagset_clear(struct tagset *ts)
+{
+   ts->word = 0;
+   if(ts->ext) memset(ts->ext, 0, ts->n_ext * sizeof(uint64_t));
+}
+
+static inline bool
+tagset_reserve(struct tagset *ts, unsigned int n_ext)
+{
+   if(n_ext <= ts->n_ext) return true;
+
+   uint64_t *ext = realloc(ts->ext, n_ext * sizeof(uint64_t));
+   if(!ext) return false;
+   memset(ext + ts->n_ext, 0, (n_ext - ts->n_ext) * sizeof(uint64_t));
+   ts->ext = ext;
+   ts->n_ext = n_ext;
+   return true;
+}
+
+static inline bool
+tagset_has(const struct tagset *ts, int tag)
+{
+   if(tag < 0) return false;
+   if(tag < 64) return ts->word & TAGSET_BIT(tag);
+   return (unsigned int)TAGSET_WORD(tag) < ts->n_ext && (ts->ext[TAGSET_WORD(tag)] & TAGSET_BIT(tag));
+}
+
+static inline void
+tagset_set(struct tagset *ts, int tag)
+{
+   if(tag < 0) return;
+   if(tag < 64) { ts->word |= TAGSET_BIT(tag); return; }
+   if(tagset_reserve(ts, TAGSET_WORD(tag) + 1))
+      ts->ext[TAGSET_WORD(tag)] |= TAGSET_BIT(tag);
+}
+
+static inline void
+tagset_toggle(struct tagset *ts, int tag)
+{
+   if(tag < 0) return;
+   if(tag < 64) { ts->word ^= TAGSET_BIT(tag); return; }
+   if(tagset_reserve(ts, TAGSET_WORD(tag) + 1))
+      ts->ext[TAGSET_WORD(tag)] ^= TAGSET_BIT(tag);
+}
+
+static inline void
+tagset_single(struct tagset *ts, int tag)
+{
+   tagset_clear(ts);
+   tagset_set(ts, tag);
+}
+
+static inline bool
+tagset_empty(const struct tagset *ts)
+{
+   uint64_t any = ts->word;
+   for(unsigned int i=0; i<ts->n_ext; i++) any |= ts->ext[i];
+   return !any;
+}
+
+static inline bool
+tagset_intersects(const struct tagset *a, const struct tagset *b)
+{
+   if(a->word & b->word) return true;
+
+   unsigned int n = a->n_ext < b->n_ext ? a->n_ext : b->n_ext;
+   uint64_t any = 0;
+   for(unsigned int i=0; i<n; i++) any |= a->ext[i] & b->ext[i];
+   return any;
+}
+
+static inline bool
+tagset_equal(const struct tagset *a, const struct tagset *b)
+{
+   if(a->word != b->word) return false;
+
+   unsigned int n = a->n_ext > b->n_ext ? a->n_ext : b->n_ext;
+   for(unsigned int i=0; i<n; i++) {
+      uint64_t wa = i < a->n_ext ? a->ext[i] : 0;
+      uint64_t wb = i < b->n_ext ? b->ext[i] : 0;
+      if(wa != wb) return false;
+   }
+   return true;
+}
+
+static inline void
+tagset_copy(struct tagset *dst, const struct tagset *src)
+{
+   if(dst == src) return;
+
+   dst->word = src->word;
+   if(dst->ext) memset(dst->ext, 0, dst->n_ext * sizeof(uint64_t));
+   if(src->n_ext && tagset_reserve(dst, src->n_ext))
+      memcpy(dst->ext, src->ext, src->n_ext * sizeof(uint64_t));
+}
+
+// first tag >= from in the set, -1 if there is none
+static inline int
+tagset_next(const struct tagset *ts, int from)
+{
+   if(from < 0) from = 0;
+   for(unsigned int i = from/64; i <= ts->n_ext; i++) {
+      uint64_t w = i==0 ? ts->word : ts->ext[i-1];
+      if(i == (unsigned int)from/64) w &= ~(uint64_t)0 << (from % 64);
+      if(w) return i*64 + __builtin_ctzll(w);
+   }
+   return -1;
+}
+
+#define tagset_for_each(T, TS) \
+   for((T) = tagset_next((TS), 0); (T) >= 0; (T) = tagset_next((TS), (T)+1))
+
+// keep only the tags below n_tags
+static inline void
+tagset_limit(struct tagset *ts, int n_tags)
+{
+   if(n_tags < 64) ts->word &= n_tags>0 ? (TAGSET_BIT(n_tags) - 1) : 0;
+   for(unsigned int i=0; i<ts->n_ext; i++) {
+      int first = (i + 1) * 64;
+      if(n_tags <= first)           ts->ext[i] = 0;
+      else if(n_tags < first + 64)  ts->ext[i] &= TAGSET_BIT(n_tags) - 1;
+   }
+}
+
+// 32-bit masks as used by dwl-ipc: only the first 32 tags can be addressed
+static inline uint32_t
+tagset_mask32(const struct tagset *ts)
+{
+   return (uint32_t)ts->word;
+}
+
+static inline void
+tagset_apply_mask32(struct tagset *ts, uint32_t and_mask, uint32_t xor_mask)
+{
+   uint32_t low = ((uint32_t)ts->word & and_mask) ^ xor_mask;
+   ts->word = (ts->word & ~(uint64_t)UINT32_MAX) | low;
+}
+
+#endif
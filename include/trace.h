@@ -0,0 +1,30 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Timeline of compositor activity, dumped as Chrome trace-event JSON
+// (chrome://tracing, ui.perfetto.dev). Built with meson -Dtracing=true.
+#ifdef TRACING
+struct trace_scope {
+   const char *name;
+   uint64_t start;
+};
+
+struct trace_scope trace_scope_begin(const char*);
+void trace_scope_end(struct trace_scope*);
+void trace_complete(const char*, const char*, uint64_t, uint64_t);
+void trace_instant(const char*, uint32_t, uint32_t);
+uint64_t trace_now();
+
+// complete event covering the rest of the enclosing block
+#define TRACE_SCOPE(N)           struct trace_scope _trace_scope \
+                                    __attribute__((cleanup(trace_scope_end))) = trace_scope_begin(N)
+#define TRACE_INSTANT(N, C, S)   trace_instant((N), (C), (S))
+#else
+#define TRACE_SCOPE(N)
+#define TRACE_INSTANT(N, C, S)   ((void)(S))
+#endif
+
+void trace_dump(const char*);
+int trace_signal_notify(int, void*);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef WALLPAPER_H
+#define WALLPAPER_H
+
+// one pre-scaled wallpaper, shared by all outputs with the same pixel size
+struct wallpaper_size {
+   struct wl_list link;
+   int width, height;
+
+   struct wallpaper_buffer *buffer; // NULL until the worker is done
+   bool pending;
+   int users;
+};
+
+void wallpaper_init();
+void wallpaper_finish();
+void wallpaper_update_outputs();
+void wallpaper_output_destroy(struct simple_output*);
+
+#endif
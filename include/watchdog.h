@@ -0,0 +1,32 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdatomic.h>
+
+// Event-loop stall detector. A timer on the event loop stamps a heartbeat; a
+// separate thread notices when it stops and reports what the loop was doing,
+// as named by the innermost WATCHDOG_SCOPE (the LISTEN trampoline in
+// -Dprofiling/-Dtracing builds names every listener).
+extern _Atomic(const char*) watchdog_active;
+
+static inline const char*
+watchdog_enter(const char *name)
+{
+   return atomic_exchange_explicit(&watchdog_active, name, memory_order_relaxed);
+}
+
+static inline void
+watchdog_leave(const char **prev)
+{
+   atomic_store_explicit(&watchdog_active, *prev, memory_order_relaxed);
+}
+
+// names the rest of the enclosing block
+#define WATCHDOG_SCOPE(N)  const char *_watchdog_prev \
+                              __attribute__((cleanup(watchdog_leave))) = watchdog_enter(N)
+
+void watchdog_init();
+void watchdog_finish();
+void watchdog_report(FILE*);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+// Small thread pool for work that must not block the event loop (file I/O,
+// image decoding, keymap compilation). run() is called on a worker thread and
+// must only touch the job's own data; done() is then called on the event loop.
+// worker_finish() runs the jobs still queued on the calling thread and calls
+// done() for every job not yet reported, so done() always frees the job's data.
+typedef void (*worker_func_t)(void *data);
+
+void worker_submit(worker_func_t run, worker_func_t done, void *data);
+void worker_init();
+void worker_finish();
+
+#endif
@@ -10,6 +10,7 @@
 #include "client.h"
 #include "server.h"
 #include "output.h"
+#include "ipc.h"
 
 void 
 key_function(struct keymap *keymap) 
@@ -29,7 +30,8 @@ key_function(struct keymap *keymap)
       if(!strcmp(keymap->argument, "fix"))      toggleFixedTag();
       if(!strcmp(keymap->argument, "tile"))     tileTag();
 
-      arrange_outputs();
+      // tags are per output, the other outputs are left alone
+      if(g_server->cur_output) arrange_output(g_server->cur_output);
    }
 
    //--- CLIENT -----
@@ -86,6 +88,28 @@ mouse_function(struct simple_client *client, struct mousemap *mousemap, int resi
 void
 process_ipc_action(const char* action)
 {
-   if(!strcmp(action, "test"))      say(INFO, "Action test");
-   if(!strcmp(action, "quit"))      wl_display_terminate(g_server->display);
+   TRACE_SCOPE("ipc_action");
+   char cmd[32] = {0}, args[96] = {0};
+   if(sscanf(action, "%31s %95[^\n]", cmd, args) < 1) return;
+
+   if(!strcmp(cmd, "test"))            say(INFO, "Action test");
+   if(!strcmp(cmd, "quit"))            wl_display_terminate(g_server->display);
+   if(!strcmp(cmd, "adaptive_sync"))   setOutputAdaptiveSync(args);
+   if(!strcmp(cmd, "report"))          ipc_report(args);
+   if(!strcmp(cmd, "profile_reset"))   profile_reset();
+   if(!strcmp(cmd, "trace_dump"))      trace_dump(args);
+   if(!strcmp(cmd, "flight_dump"))     flight_dump(0);
+
+   //--- TAG (1-based, reaches tags the key bindings and dwl-ipc masks cannot) -----
+   int tag = atoi(args) - 1;
+   if(!strcmp(cmd, "view") || !strcmp(cmd, "toggle_view")) {
+      setCurrentTag(tag, !strcmp(cmd, "toggle_view"));
+      if(g_server->cur_output) arrange_output(g_server->cur_output);
+   }
+   if(!strcmp(cmd, "send_to_tag")) {
+      struct simple_client* client = NULL;
+      if(get_client_from_surface(g_server->seat->keyboard_state.focused_surface, &client, NULL)<0 || !client) return;
+      sendClientToTag(client, tag);
+      arrange_output(client->output);
+   }
 }
@@ -13,6 +13,12 @@
 #include "client.h"
 #include "server.h"
 #include "output.h"
+#include "launch.h"
+#include "worker.h"
+#include "popup.h"
+#include "pool.h"
+
+POOL(client_pool, simple_client);
 
 static inline struct wlr_surface*
 get_client_surface(struct simple_client *client)
@@ -30,7 +36,9 @@ sendClientToTag(struct simple_client *client, int tag)
 {
    if(!client) return;
 
-   client->tag = TAGMASK(tag);
+   if(tag<0 || tag>=g_config->n_tags) return;
+
+   tagset_single(&client->tag, tag);
    print_server_info();
 }
 
@@ -46,10 +54,10 @@ toggleClientVisible(struct simple_client *client)
 void
 toggleClientFixed(struct simple_client *client) 
 {
-   if(!client) return;
+   if(!client || !client->output) return;
    
    if(client->fixed)
-      client->tag = g_server->current_tag;
+      tagset_copy(&client->tag, &client->output->current_tag);
 
    client->fixed ^= 1;
 }
@@ -58,7 +66,7 @@ void
 setClientFullscreen(struct simple_client *client, int fullscreen)
 {
    say(DEBUG, "setClientFullscreen");
-   if(!client) return;
+   if(!client || !client->output) return;
 
    client->fullscreen = fullscreen;
 #ifdef XWAYLAND
@@ -84,6 +92,8 @@ setClientFullscreen(struct simple_client *client, int fullscreen)
       client->geom = client->prev_geom;
       set_client_geometry(client, true);
    }
+
+   output_update_adaptive_sync(client->output);
 }
 
 void
@@ -98,7 +108,7 @@ toggleClientFullscreen(struct simple_client *client)
 void
 maximizeClient(struct simple_client *client, int maximize)
 {
-   if(!client) return;
+   if(!client || !client->output) return;
 
    int gap_width = g_config->tile_gap_width;
    int bw = g_config->border_width;
@@ -179,8 +189,7 @@ cycleClients(struct simple_output *output)
    wl_list_for_each(client, &selected->link, link) {
       if(&client->link == &g_server->clients)
          continue; // wrap past the sentinel node
-      //if(client->output==output && (client->fixed || (client->tag & g_server->visible_tags)))
-      if(client->fixed || (client->tag & g_server->visible_tags))
+      if(client->output==output && is_client_tag_visible(client))
          break;
    }
 
@@ -250,6 +259,18 @@ get_client_title(struct simple_client* client)
    return client->xdg_surface->toplevel->title;
 }
 
+pid_t
+get_client_pid(struct simple_client* client)
+{
+   if(client->pid) return client->pid;
+#if XWAYLAND
+   if(client->type==XWL_MANAGED_CLIENT || client->type==XWL_UNMANAGED_CLIENT)
+      return client->pid = client->xwl_surface->pid;
+#endif
+   wl_client_get_credentials(client->xdg_surface->client->client, &client->pid, NULL, NULL);
+   return client->pid;
+}
+
 char *
 get_client_appid(struct simple_client* client)
 {
@@ -267,12 +288,20 @@ get_top_client_from_output(struct simple_output* output, bool include_hidden)
    if(!output) return NULL;
    wl_list_for_each(client, &g_server->clients, link) {
       if(!client || &client->link == &g_server->clients) continue; 
-      if((include_hidden || client->visible) && client->output==output && (client->fixed || (client->tag & g_server->visible_tags)))
+      if((include_hidden || client->visible) && client->output==output && is_client_tag_visible(client))
          return client;
    }
    return NULL;
 }
 
+bool
+is_client_tag_visible(struct simple_client* client)
+{
+   // tags are per output: check against the tags shown on the client's output
+   if(client->fixed) return true;
+   return client->output && tagset_intersects(&client->tag, output_visible_tags(client->output));
+}
+
 int
 get_client_at(double lx, double ly, struct simple_client **client, struct wlr_surface **surface, double *sx, double *sy) 
 {
@@ -420,24 +449,59 @@ update_border_geometry(struct simple_client *client)
    wlr_scene_node_set_position(&client->border[3]->node, client->geom.width, -bw);
 }
 
-void 
-set_client_geometry(struct simple_client *client, bool request_resize) 
+#if XWAYLAND
+// configure counters of X11 clients that have gone already
+static uint64_t xwl_gone_requests, xwl_gone_sent, xwl_gone_skipped;
+
+static bool
+xwl_configure(struct simple_client *client, struct wlr_box *box, bool reply)
+{
+   // A configure equal to the last one is only sent when it answers a
+   // ConfigureRequest: ICCCM clients wait for the synthetic ConfigureNotify.
+   if(!reply && client->configures_sent && wlr_box_equal(box, &client->configure_sent)) {
+      client->configures_skipped++;
+      return false;
+   }
+
+   wlr_xwayland_surface_configure(client->xwl_surface, box->x, box->y, box->width, box->height);
+   client->configure_sent = *box;
+   client->configures_sent++;
+   return true;
+}
+#endif
+
+// reply: answers a ConfigureRequest (X11), sent even if nothing changed
+static void
+apply_client_geometry(struct simple_client *client, bool request_resize, bool reply)
 {
    say(DEBUG, "size = %dx%d+%d+%d", client->geom.width, client->geom.height, client->geom.x, client->geom.y);
    client->resize_requested = request_resize;
    if(client->type==XDG_SHELL_CLIENT){
       wlr_scene_node_set_position(&client->scene_tree->node, client->geom.x, client->geom.y);
       wlr_scene_node_set_position(&client->scene_surface_tree->node, 0, 0);
-      wlr_xdg_toplevel_set_size(client->xdg_surface->toplevel, client->geom.width, client->geom.height);
+      uint32_t serial = wlr_xdg_toplevel_set_size(client->xdg_surface->toplevel, client->geom.width, client->geom.height);
+      TRACE_INSTANT("configure", get_client_pid(client), serial);
+      flight_record(FL_CONFIGURE, get_client_pid(client), serial, client->geom.width<<16 | (client->geom.height & 0xffff), NULL);
+      PROBE(client_configure, get_client_pid(client), serial, client->geom.width, client->geom.height);
 #if XWAYLAND
    } else {
       wlr_scene_node_set_position(&client->scene_tree->node, client->geom.x, client->geom.y);
       wlr_scene_node_set_position(&client->scene_surface_tree->node, 0, 0);
-      wlr_xwayland_surface_configure(client->xwl_surface, 
-         client->geom.x, client->geom.y, client->geom.width, client->geom.height);
+      if(xwl_configure(client, &client->geom, reply)) {
+         TRACE_INSTANT("configure", get_client_pid(client), 0);
+         flight_record(FL_CONFIGURE, get_client_pid(client), 0, client->geom.width<<16 | (client->geom.height & 0xffff), NULL);
+         PROBE(client_configure, get_client_pid(client), 0, client->geom.width, client->geom.height);
+      }
       update_border_geometry(client);
 #endif
    }
+   popup_unconstrain_children(client, NULL);
+}
+
+void 
+set_client_geometry(struct simple_client *client, bool request_resize) 
+{
+   apply_client_geometry(client, request_resize, false);
 }
 
 void 
@@ -450,11 +514,37 @@ set_client_border_colour(struct simple_client *client, int colour)
    }
 }
 
+void
+client_report(FILE *f)
+{
+   static const char *type_str[] = { "xdg", "layer", "x11", "x11-or" };
+
+   fprintf(f, "%-8s %8s %-24s %10s %10s %10s\n", "type", "pid", "app_id", "cfg_req", "cfg_sent", "cfg_skip");
+   struct simple_client *client;
+   wl_list_for_each(client, &g_server->clients, link) {
+      const char *app_id = get_client_appid(client);
+      fprintf(f, "%-8s %8d %-24.24s", type_str[client->type], get_client_pid(client), app_id ? app_id : "");
+#if XWAYLAND
+      if(client->type==XWL_MANAGED_CLIENT || client->type==XWL_UNMANAGED_CLIENT) {
+         fprintf(f, " %10u %10u %10u", client->configure_requests, client->configures_sent, client->configures_skipped);
+      }
+#endif
+      fprintf(f, "\n");
+   }
+#if XWAYLAND
+   fprintf(f, "\nclosed X11 clients: %llu configure requests, %llu configures sent, %llu skipped\n",
+         (unsigned long long)xwl_gone_requests, (unsigned long long)xwl_gone_sent,
+         (unsigned long long)xwl_gone_skipped);
+#endif
+}
+
 void 
 focus_client(struct simple_client *client, bool raise) 
 {
    say(DEBUG, "focus_client()");
    if(!client) return;
+   TRACE_SCOPE("focus_client");
+   flight_record(FL_FOCUS, get_client_pid(client), 0, 0, NULL);
 
    struct wlr_surface *surface = get_client_surface(client); 
    if(!surface) return;
@@ -497,7 +587,8 @@ focus_client(struct simple_client *client, bool raise)
       set_client_border_colour(client, FOCUSED);
    
    // set fullscreen layer
-   wlr_scene_node_set_enabled(&client->output->fullscreen_bg->node, client->fullscreen);
+   if(client->output)
+      wlr_scene_node_set_enabled(&client->output->fullscreen_bg->node, client->fullscreen);
 
    input_focus_surface(surface);
 
@@ -573,6 +664,7 @@ static void
 map_notify(struct wl_listener *listener, void *data) 
 {
    say(DEBUG, "client_map_notify");
+   WATCHDOG_SCOPE("client_map");
    struct simple_client *client = wl_container_of(listener, client, map);
    struct simple_output* op = g_server->cur_output;
 
@@ -597,7 +689,10 @@ map_notify(struct wl_listener *listener, void *data)
    }
 
    client->output = op;
-   client->tag = g_server->current_tag;
+   if(op)
+      tagset_copy(&client->tag, &op->current_tag);
+   else
+      tagset_single(&client->tag, 0);
    client->visible = true;
    client->fixed = false;
    client->urgent = false;
@@ -617,7 +712,8 @@ map_notify(struct wl_listener *listener, void *data)
 
    if(client->type==XWL_MANAGED_CLIENT){
       struct wlr_xwayland_surface *xsurface = client->xwl_surface;
-      for(int i=0; i<xsurface->window_type_len; i++)
+      // until the atoms are interned no window type is known, so it is treated as normal
+      for(int i=0; g_server->netatom_ready && i<xsurface->window_type_len; i++)
          if(xsurface->window_type[i] == g_server->netatom[NetWMWindowTypeDialog]
             || xsurface->window_type[i] == g_server->netatom[NetWMWindowTypeSplash]
             || xsurface->window_type[i] == g_server->netatom[NetWMWindowTypeToolbar]
@@ -636,6 +732,9 @@ map_notify(struct wl_listener *listener, void *data)
 
    wlr_scene_node_reparent(&client->scene_tree->node, g_server->layer_tree[LyrClient]);
 
+   PROBE(client_map, get_client_pid(client), client->type);
+   flight_record(FL_MAP, get_client_pid(client), client->type, 0, NULL);
+   launch_client_map(client);
    focus_client(client, true);
 }
 
@@ -644,6 +743,9 @@ unmap_notify(struct wl_listener *listener, void *data)
 {
    say(DEBUG, "client_unmap_notify");
    struct simple_client *client = wl_container_of(listener, client, unmap);
+   PROBE(client_unmap, get_client_pid(client));
+   flight_record(FL_UNMAP, get_client_pid(client), 0, 0, NULL);
+   launch_client_unmap(client);
 
    // reset the cursor mode if the grabbed client was unmapped
    if(client == g_server->grabbed_client) {
@@ -668,12 +770,16 @@ unmap_notify(struct wl_listener *listener, void *data)
 
    if(client->scene_tree)
       wlr_scene_node_destroy(&client->scene_tree->node);
+
+   if(client->fullscreen)
+      output_update_adaptive_sync(client->output);
 }
 
 static void
 commit_notify(struct wl_listener *listener, void *data)
 {
    say(DEBUG, "client_commit_notify");
+   WATCHDOG_SCOPE("client_commit");
    struct simple_client *client = wl_container_of(listener, client, commit);
 
    if(client->xdg_surface->initial_commit){
@@ -685,6 +791,18 @@ commit_notify(struct wl_listener *listener, void *data)
       return;
    }
    
+   PROBE(client_commit, get_client_pid(client), client->xdg_surface->current.configure_serial);
+   flight_record(FL_COMMIT, get_client_pid(client), client->xdg_surface->current.configure_serial, 0, NULL);
+   launch_client_commit(client);
+
+#ifdef TRACING
+   uint32_t serial = client->xdg_surface->current.configure_serial;
+   TRACE_INSTANT("commit", get_client_pid(client), serial);
+   if(serial != client->acked_serial)
+      TRACE_INSTANT("ack_configure", get_client_pid(client), serial);
+   client->acked_serial = serial;
+#endif
+
    if(client->resize_requested){ 
       update_border_geometry(client);
       client->resize_requested=false;
@@ -697,7 +815,7 @@ destroy_notify(struct wl_listener *listener, void *data)
    say(DEBUG, "client_destroy_notify");
    struct simple_client *client = wl_container_of(listener, client, destroy);
 
-   if(client->fullscreen)
+   if(client->fullscreen && client->output)
       wlr_scene_node_set_enabled(&client->output->fullscreen_bg->node, 0);
 
    // Remove reference to the client in the scene_tree
@@ -717,9 +835,16 @@ destroy_notify(struct wl_listener *listener, void *data)
       wl_list_remove(&client->request_configure.link);
       wl_list_remove(&client->set_title.link);
       wl_list_remove(&client->set_hints.link);
+      if(client->configure_idle) wl_event_source_remove(client->configure_idle);
+      xwl_gone_requests += client->configure_requests;
+      xwl_gone_sent += client->configures_sent;
+      xwl_gone_skipped += client->configures_skipped;
 #endif
    }
-   free(client);
+   launch_client_unmap(client);   // matched on commit but never mapped
+   popup_owner_destroy(client, NULL);
+   tagset_finish(&client->tag);
+   pool_free(&client_pool, client);
 
    //arrange_output(g_server->cur_output);
    //focus_client(get_top_client_from_output(g_server->cur_output, false), true);
@@ -727,32 +852,6 @@ destroy_notify(struct wl_listener *listener, void *data)
    print_server_info();
 }
 
-static void
-popup_commit_notify(struct wl_listener *listener, void *data)
-{
-   struct wlr_surface *surface = data;
-   struct wlr_xdg_popup *popup = wlr_xdg_popup_try_from_wlr_surface(surface);
-
-   struct simple_client* client = NULL;
-   struct simple_layer_surface *lsurface = NULL;
-
-   struct wlr_box box;
-
-   if (!popup->base->initial_commit) return;
-
-   int type = get_client_from_surface(popup->base->surface, &client, &lsurface);
-   if(!popup->parent || type<0) return;
-
-   struct wlr_scene_tree *tree = wlr_scene_xdg_surface_create(popup->parent->data, popup->base);
-   popup->base->surface->data = tree;
-   box = type == LAYER_SHELL_CLIENT ? lsurface->output->usable_area : client->output->usable_area;
-   box.x -= (type==LAYER_SHELL_CLIENT ? lsurface->geom.x : client->geom.x); 
-   box.y -= (type==LAYER_SHELL_CLIENT ? lsurface->geom.y : client->geom.y);
-   wlr_xdg_popup_unconstrain_from_box(popup, &box);
-
-   wl_list_remove(&listener->link);
-}
-
 static void
 fullscreen_notify(struct wl_listener *listener, void *data)
 {
@@ -779,7 +878,7 @@ xdg_new_toplevel_notify(struct wl_listener *listener, void *data)
    struct wlr_xdg_toplevel *xdg_toplevel = data;
 
    // allocate a simple_client for this surface
-   struct simple_client *xdg_client = calloc(1, sizeof(struct simple_client));
+   struct simple_client *xdg_client = pool_alloc(&client_pool);
    xdg_client->type = XDG_SHELL_CLIENT;
    xdg_client->xdg_surface = xdg_toplevel->base;
 
@@ -790,17 +889,6 @@ xdg_new_toplevel_notify(struct wl_listener *listener, void *data)
    LISTEN(&xdg_toplevel->events.request_fullscreen, &xdg_client->request_fullscreen, fullscreen_notify);
 }
 
-static struct wl_listener popup_commit_listener;
-
-void
-xdg_new_popup_notify(struct wl_listener *listener, void *data)
-{
-   //void
-   struct wlr_xdg_popup *xdg_popup = data;
-
-   LISTEN(&xdg_popup->base->surface->events.commit, &popup_commit_listener, &popup_commit_notify);
-}
-
 //---- XWayland Shell ----------------------------------------------------
 #if XWAYLAND
 static void 
@@ -832,20 +920,42 @@ xwl_request_activate_notify(struct wl_listener *listener, void *data)
       wlr_xwayland_surface_activate(client->xwl_surface, 1);
 }
 
+static void
+xwl_configure_idle_notify(void *data)
+{
+   WATCHDOG_SCOPE("xwl_configure");
+   struct simple_client *client = data;
+   client->configure_idle = NULL;
+
+   if(!wlr_box_empty(&client->geom)){
+      client->geom = client->configure_request;
+      apply_client_geometry(client, true, true);
+   } else {
+      xwl_configure(client, &client->configure_request, true);
+   }
+}
+
 static void 
 xwl_request_configure_notify(struct wl_listener *listener, void *data) 
 {
    say(DEBUG, "xwl_request_configure_notify");
    struct simple_client *client = wl_container_of(listener, client, request_configure);
    struct wlr_xwayland_surface_configure_event *event = data;
-
-   if(!wlr_box_empty(&client->geom)){
-      client->geom.x = event->x;          client->geom.y = event->y;
-      client->geom.width = event->width;  client->geom.height = event->height;
-      set_client_geometry(client, true);
+   client->configure_requests++;
+
+   // Java and Wine send bursts of these; only the fields named in the mask
+   // are taken from later requests, the first one starts from the surface
+   struct wlr_box *req = &client->configure_request;
+   if(!client->configure_idle) {
+      *req = (struct wlr_box){ event->x, event->y, event->width, event->height };
+      client->configure_idle =
+         wl_event_loop_add_idle(g_server->event_loop, xwl_configure_idle_notify, client);
+      return;
    }
-
-   wlr_xwayland_surface_configure(client->xwl_surface, event->x, event->y, event->width, event->height);
+   if(event->mask & XCB_CONFIG_WINDOW_X)       req->x = event->x;
+   if(event->mask & XCB_CONFIG_WINDOW_Y)       req->y = event->y;
+   if(event->mask & XCB_CONFIG_WINDOW_WIDTH)   req->width = event->width;
+   if(event->mask & XCB_CONFIG_WINDOW_HEIGHT)  req->height = event->height;
 }
 
 static void
@@ -868,16 +978,60 @@ xwl_request_fullscreen_notify(struct wl_listener *listener, void *data)
 }
 */
 
-xcb_atom_t
-getatom(xcb_connection_t *xc, const char *name)
+//--- Atoms --------------------------------------------------------------
+// Interned on the worker pool: connect, send every request, then collect the
+// replies, so each added atom costs no extra round trip.
+static const char *netatom_names[NetLast] = {
+   [NetWMWindowTypeDialog]    = "_NET_WM_WINDOW_TYPE_DIALOG",
+   [NetWMWindowTypeSplash]    = "_NET_WM_WINDOW_TYPE_SPLASH",
+   [NetWMWindowTypeToolbar]   = "_NET_WM_WINDOW_TYPE_TOOLBAR",
+   [NetWMWindowTypeUtility]   = "_NET_WM_WINDOW_TYPE_UTILITY",
+};
+
+struct atom_job {
+   char display[32];
+   unsigned int generation;
+   int error;
+   xcb_atom_t atoms[NetLast];
+};
+
+static void
+intern_atoms(void *data)
+{
+   struct atom_job *job = data;
+   xcb_connection_t *xc = xcb_connect(job->display, NULL);
+   if((job->error = xcb_connection_has_error(xc))) {
+      xcb_disconnect(xc);
+      return;
+   }
+
+   xcb_intern_atom_cookie_t cookies[NetLast];
+   for(int i=0; i<NetLast; i++)
+      cookies[i] = xcb_intern_atom(xc, 0, strlen(netatom_names[i]), netatom_names[i]);
+
+   for(int i=0; i<NetLast; i++) {
+      xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(xc, cookies[i], NULL);
+      if(reply) job->atoms[i] = reply->atom;
+      free(reply);
+   }
+   xcb_disconnect(xc);
+}
+
+static void
+intern_atoms_done(void *data)
 {
-   xcb_atom_t atom = 0;
-   xcb_intern_atom_reply_t *reply;
-   xcb_intern_atom_cookie_t cookie = xcb_intern_atom(xc, 0, strlen(name), name);
-   if ((reply = xcb_intern_atom_reply(xc, cookie, NULL)))
-      atom = reply->atom;
-   free(reply);
-   return atom;
+   struct atom_job *job = data;
+
+   // a result from an Xwayland that has been restarted since is useless
+   if(job->generation == g_server->netatom_generation) {
+      if(job->error) {
+         say(WARNING, "xcb_connect to X server failed with code %d", job->error);
+      } else {
+         memcpy(g_server->netatom, job->atoms, sizeof(g_server->netatom));
+         g_server->netatom_ready = true;
+      }
+   }
+   free(job);
 }
 
 //------------------------------------------------------------------------
@@ -886,15 +1040,11 @@ xwl_ready_notify(struct wl_listener *listener, void *data)
 {
    say(DEBUG, "xwl_ready_notify");
 
-   xcb_connection_t *xc = xcb_connect(g_server->xwayland->display_name, NULL);
-   int err = xcb_connection_has_error(xc);
-   if(err)
-      say(WARNING, "xcb_connect to X server failed with code %d", err);
-
-   g_server->netatom[NetWMWindowTypeDialog] = getatom(xc, "_NET_WM_WINDOW_TYPE_DIALOG");
-   g_server->netatom[NetWMWindowTypeSplash] = getatom(xc, "_NET_WM_WINDOW_TYPE_SPLASH");
-   g_server->netatom[NetWMWindowTypeToolbar] = getatom(xc, "_NET_WM_WINDOW_TYPE_TOOLBAR");
-   g_server->netatom[NetWMWindowTypeUtility] = getatom(xc, "_NET_WM_WINDOW_TYPE_UTILITY");
+   struct atom_job *job = calloc(1, sizeof(struct atom_job));
+   snprintf(job->display, sizeof job->display, "%s", g_server->xwayland->display_name);
+   job->generation = ++g_server->netatom_generation;
+   g_server->netatom_ready = false;
+   worker_submit(intern_atoms, intern_atoms_done, job);
 
    wlr_xwayland_set_seat(g_server->xwayland, g_server->seat);
    
@@ -905,8 +1055,6 @@ xwl_ready_notify(struct wl_listener *listener, void *data)
       wlr_xwayland_set_cursor(g_server->xwayland, image->buffer, 
             image->width*4, image->width, image->height, image->hotspot_x, image->hotspot_y);
    }
-
-   xcb_disconnect(xc);
 }
 
 void 
@@ -916,7 +1064,7 @@ xwl_new_surface_notify(struct wl_listener *listener, void *data)
    struct wlr_xwayland_surface *xsurface = data;
 
    // Create simple_client for this surface 
-   struct simple_client *xwl_client = calloc(1, sizeof(struct simple_client));
+   struct simple_client *xwl_client = pool_alloc(&client_pool);
    xwl_client->type = xsurface->override_redirect ? XWL_UNMANAGED_CLIENT : XWL_MANAGED_CLIENT;
    xwl_client->xwl_surface = xsurface;
 
@@ -4,6 +4,10 @@
 #include <wlr/types/wlr_keyboard.h>
 
 #include "globals.h"
+#include "pool.h"
+
+POOL(keymap_pool, keymap);
+POOL(mousemap_pool, mousemap);
 
 void 
 colour2rgba(const char *color, float dest[static 4]) 
@@ -47,6 +51,112 @@ trim(char *orig)
    memmove(orig, orig+i, len -i + 1);
 }
 
+int
+parse_adaptive_sync(const char *value)
+{
+   if(!strcmp(value, "on") || !strcmp(value, "true"))  return VRR_ON;
+   if(!strcmp(value, "fullscreen"))                    return VRR_FULLSCREEN;
+   return VRR_OFF;
+}
+
+int
+parse_transform(const char *value)
+{
+   const char *names[] = { "normal", "90", "180", "270", "flipped", "flipped-90", "flipped-180", "flipped-270" };
+   for(int i=0; i<LENGTH(names); i++)
+      if(!strcmp(value, names[i])) return i;
+   return -1;
+}
+
+void
+parse_output_profile_entry(char *value)
+{
+   // OUTPUT = <profile> <output> [disable] [mode=WxH[@Hz]] [pos=X,Y] [scale=S] [transform=T] [adaptive_sync=A]
+   char *name = strtok(value, " ");
+   char *match = strtok(NULL, " ");
+   if(!name || !match) return;
+
+   struct output_profile *profile, *found = NULL;
+   wl_list_for_each(profile, &g_config->output_profiles, link) {
+      if(!strcmp(profile->name, name)) { found = profile; break; }
+   }
+   if(!found) {
+      found = calloc(1, sizeof(struct output_profile));
+      strncpy(found->name, name, sizeof found->name);
+      wl_list_init(&found->entries);
+      // keep the order of the config file - first matching profile wins
+      wl_list_insert(g_config->output_profiles.prev, &found->link);
+   }
+
+   struct output_profile_entry *entry = calloc(1, sizeof(struct output_profile_entry));
+   strncpy(entry->match, match, sizeof entry->match);
+   entry->enabled = true;
+   entry->transform = -1;
+   entry->adaptive_sync = -1;
+
+   char *token;
+   while((token = strtok(NULL, " "))) {
+      if(!strcmp(token, "disable"))
+         entry->enabled = false;
+      else if(!strncmp(token, "mode=", 5)) {
+         float hz = 0;
+         sscanf(token+5, "%dx%d@%f", &entry->width, &entry->height, &hz);
+         entry->refresh = (int)(hz * 1000);
+      } else if(!strncmp(token, "pos=", 4))
+         entry->has_position = sscanf(token+4, "%d,%d", &entry->x, &entry->y)==2;
+      else if(!strncmp(token, "scale=", 6))
+         entry->scale = atof(token+6);
+      else if(!strncmp(token, "transform=", 10))
+         entry->transform = parse_transform(token+10);
+      else if(!strncmp(token, "adaptive_sync=", 14))
+         entry->adaptive_sync = parse_adaptive_sync(token+14);
+   }
+
+   wl_list_insert(found->entries.prev, &entry->link);
+}
+
+static void
+parse_wallpaper(char *value)
+{
+   // wallpaper = <path> [fill|fit|center|stretch|tile]
+   const char *modes[] = { "fill", "fit", "center", "stretch", "tile" };
+   g_config->wallpaper_mode = WP_FILL;
+
+   char *last = strrchr(value, ' ');
+   if(last) {
+      for(size_t i=0; i<LENGTH(modes); i++) {
+         if(strcmp(last+1, modes[i])) continue;
+         g_config->wallpaper_mode = i;
+         *last = '\0';
+         trim(value);
+         break;
+      }
+   }
+   strncpy(g_config->wallpaper, value, sizeof g_config->wallpaper - 1);
+}
+
+static void
+parse_xwayland_mode(const char *value)
+{
+   // xwayland_mode = eager|lazy|idle-exit:<seconds>
+   int seconds;
+   if(!strcmp(value, "eager"))
+      g_config->xwayland_mode = XWL_EAGER;
+   else if(!strcmp(value, "lazy"))
+      g_config->xwayland_mode = XWL_LAZY;
+   else if(sscanf(value, "idle-exit:%d", &seconds) == 1 && seconds > 0) {
+      g_config->xwayland_mode = XWL_IDLE_EXIT;
+      g_config->xwayland_idle_exit = seconds;
+      // wlroots only restarts an Xwayland that ran for more than 5 s (crash
+      // loop guard); an earlier idle exit would leave DISPLAY dead for good
+      if(seconds < XWL_IDLE_EXIT_MIN) {
+         say(WARNING, "xwayland_mode: idle-exit below %d s is raised to %d s", XWL_IDLE_EXIT_MIN, XWL_IDLE_EXIT_MIN);
+         g_config->xwayland_idle_exit = XWL_IDLE_EXIT_MIN;
+      }
+   } else
+      say(WARNING, "Unknown xwayland_mode '%s', using lazy", value);
+}
+
 //------------------------------------------------------------------------
 void 
 set_defaults()
@@ -56,8 +166,11 @@ set_defaults()
    g_config->focus_type = 0;
    g_config->moveresize_step = 10;
    g_config->new_client_placement = HYBRID;
+   g_config->adaptive_sync = VRR_OFF;
 
    colour2rgba("#111111", g_config->background_colour);
+   g_config->wallpaper[0] = '\0';
+   g_config->wallpaper_mode = WP_FILL;
    colour2rgba("#0000FF", g_config->border_colour[FOCUSED]);
    colour2rgba("#CCCCCC", g_config->border_colour[UNFOCUSED]);
    colour2rgba("#FF0000", g_config->border_colour[URGENT]);
@@ -66,7 +179,13 @@ set_defaults()
    colour2rgba("#FFFFFF", g_config->border_colour[OUTLINE]);
 
    g_config->autostart_script[0] = '\0';
+   g_config->log_file[0] = '\0';
+   g_config->log_file_max_size = 1024;
+   g_config->watchdog_threshold = 0;
+   g_config->watchdog_backtrace = false;
    g_config->xkb_layout[0] = '\0';
+   g_config->xwayland_mode = XWL_LAZY;
+   g_config->xwayland_idle_exit = 0;
    g_config->xkb_options[0] = '\0';
 
    g_config->tablet_rotation = 0;
@@ -85,6 +204,9 @@ readConfiguration(char* filename)
 
    wl_list_init(&g_config->key_bindings);
    wl_list_init(&g_config->mouse_bindings);
+   wl_list_init(&g_config->output_rules);
+   wl_list_init(&g_config->output_profiles);
+   wl_list_init(&g_config->tearing_rules);
 
    FILE *f;
    if(!(f=fopen(g_config->config_file_name, "r"))){
@@ -109,7 +231,7 @@ readConfiguration(char* filename)
 
       say(DEBUG, "config id = '%s' / value = '%s'", id, value);
          
-      if(!strcmp(id, "n_tags")) g_config->n_tags=atoi(value);
+      if(!strcmp(id, "n_tags")) g_config->n_tags=MAX(1, atoi(value));
 
       if(!strcmp(id, "border_width"))     g_config->border_width = atoi(value);
       if(!strcmp(id, "tile_gap_width"))   g_config->tile_gap_width = atoi(value);
@@ -117,8 +239,10 @@ readConfiguration(char* filename)
       if(!strcmp(id, "focus_type"))       g_config->focus_type = atoi(value);
       if(!strcmp(id, "touchpad_tap_click"))  g_config->touchpad_tap_click = !strcmp(value, "true") ? true : false; 
       if(!strcmp(id, "new_client_placement")) g_config->new_client_placement = atoi(value);
+      if(!strcmp(id, "adaptive_sync"))    g_config->adaptive_sync = parse_adaptive_sync(value);
 
       if(!strcmp(id, "background_colour"))      colour2rgba(value, g_config->background_colour);
+      if(!strcmp(id, "wallpaper"))              parse_wallpaper(value);
       if(!strcmp(id, "border_colour_focus"))    colour2rgba(value, g_config->border_colour[FOCUSED]);
       if(!strcmp(id, "border_colour_unfocus"))  colour2rgba(value, g_config->border_colour[UNFOCUSED]);
       if(!strcmp(id, "border_colour_urgent"))   colour2rgba(value, g_config->border_colour[URGENT]);
@@ -126,11 +250,18 @@ readConfiguration(char* filename)
       if(!strcmp(id, "border_colour_fixed"))    colour2rgba(value, g_config->border_colour[FIXED]);
       if(!strcmp(id, "border_colour_outline"))  colour2rgba(value, g_config->border_colour[OUTLINE]);
 
+      if(!strcmp(id, "log_file"))            strncpy(g_config->log_file, value, sizeof g_config->log_file - 1);
+      if(!strcmp(id, "log_file_max_size"))   g_config->log_file_max_size = atoi(value);
+      if(!strcmp(id, "watchdog_threshold"))  g_config->watchdog_threshold = MAX(0, atoi(value));
+      if(!strcmp(id, "watchdog_backtrace"))  g_config->watchdog_backtrace = !strcmp(value, "true");
+
       if(!strcmp(id, "autostart"))     strncpy(g_config->autostart_script, value, sizeof g_config->autostart_script);
 
       if(!strcmp(id, "xkb_layout"))    strncpy(g_config->xkb_layout, value, sizeof g_config->xkb_layout);
       if(!strcmp(id, "xkb_options"))   strncpy(g_config->xkb_options, value, sizeof g_config->xkb_options);
 
+      if(!strcmp(id, "xwayland_mode")) parse_xwayland_mode(value);
+
       if(!strcmp(id, "tablet_rotation"))  g_config->tablet_rotation = atoi(value);
       if(!strcmp(id, "tablet_boundary_x")){
          token = strtok(value, " ");
@@ -146,6 +277,22 @@ readConfiguration(char* filename)
          token = strtok(NULL, " ");
          g_config->tablet_boundary_y[1] = atof(token);
       }
+      if(!strcmp(id, "ADAPTIVE_SYNC") && (token = strtok(value, " "))){
+         // calloc leaves the last byte of a full-length name as the terminator
+         struct output_rule *rule = calloc(1, sizeof(struct output_rule));
+         strncpy(rule->name, token, sizeof rule->name - 1);
+
+         token = strtok(NULL, " ");
+         rule->adaptive_sync = token ? parse_adaptive_sync(token) : VRR_ON;
+
+         wl_list_insert(&g_config->output_rules, &rule->link);
+      }
+      if(!strcmp(id, "OUTPUT"))    parse_output_profile_entry(value);
+      if(!strcmp(id, "TEARING_ALLOW")){
+         struct tearing_rule *rule = calloc(1, sizeof(struct tearing_rule));
+         strncpy(rule->app_id, value, sizeof rule->app_id);
+         wl_list_insert(&g_config->tearing_rules, &rule->link);
+      }
       if(!strcmp(id, "KEY")){
          char binding[32];
          token = strtok(value, " ");
@@ -188,7 +335,7 @@ readConfiguration(char* filename)
          else if(!strcmp(function, "SPAWN"))    this_fn = SPAWN;
          else if(!strcmp(function, "CLIENT"))   this_fn = CLIENT;
          
-         struct keymap *keybind = calloc(1, sizeof(struct keymap));
+         struct keymap *keybind = pool_alloc(&keymap_pool);
          keybind->mask = mod;
          keybind->keysym = keysym;
          keybind->keyfn = this_fn;
@@ -240,7 +387,7 @@ readConfiguration(char* filename)
               if(!strcmp(context, "ROOT"))   this_context = CONTEXT_ROOT;
          else if(!strcmp(context, "CLIENT")) this_context = CONTEXT_CLIENT;
 
-         struct mousemap *mousebind = calloc(1, sizeof(struct mousemap));
+         struct mousemap *mousebind = pool_alloc(&mousemap_pool);
          mousebind->mask = mod;
          mousebind->button = button;
          mousebind->context = this_context;
@@ -251,6 +398,45 @@ readConfiguration(char* filename)
    }
    fclose(f);
 }
+void
+freeConfiguration()
+{
+   struct keymap *keybind, *ktmp;
+   wl_list_for_each_safe(keybind, ktmp, &g_config->key_bindings, link) {
+      wl_list_remove(&keybind->link);
+      pool_free(&keymap_pool, keybind);
+   }
+
+   struct mousemap *mousebind, *mtmp;
+   wl_list_for_each_safe(mousebind, mtmp, &g_config->mouse_bindings, link) {
+      wl_list_remove(&mousebind->link);
+      pool_free(&mousemap_pool, mousebind);
+   }
+
+   struct output_rule *orule, *otmp;
+   wl_list_for_each_safe(orule, otmp, &g_config->output_rules, link) {
+      wl_list_remove(&orule->link);
+      free(orule);
+   }
+
+   struct output_profile *profile, *ptmp;
+   wl_list_for_each_safe(profile, ptmp, &g_config->output_profiles, link) {
+      struct output_profile_entry *entry, *etmp;
+      wl_list_for_each_safe(entry, etmp, &profile->entries, link) {
+         wl_list_remove(&entry->link);
+         free(entry);
+      }
+      wl_list_remove(&profile->link);
+      free(profile);
+   }
+
+   struct tearing_rule *trule, *ttmp;
+   wl_list_for_each_safe(trule, ttmp, &g_config->tearing_rules, link) {
+      wl_list_remove(&trule->link);
+      free(trule);
+   }
+}
+
 /*
 void
 reloadConfiguration() {
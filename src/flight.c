@@ -0,0 +1,118 @@
+/*
+ * flight.c
+ *   - Crash flight recorder
+ *
+ * flight_record() is a clock read and a 32-byte store into a static ring owned
+ * by the main thread, cheap enough to leave on in production. flight_dump() only
+ * uses async-signal-safe calls, so the crash handler can write the ring out.
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+#include "globals.h"
+
+static struct flight_record ring[FLIGHT_RING_SIZE];
+static uint64_t head;
+static char dump_path[256];   // built at start-up, getenv() is not signal safe
+static char alt_stack[1 << 16];
+
+static const int crash_signals[] = { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL };
+
+static uint64_t
+flight_now()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void
+flight_record(int type, uint32_t id, uint32_t a, uint32_t b, const char *name)
+{
+   struct flight_record *r = &ring[head++ & (FLIGHT_RING_SIZE - 1)];
+   r->ts = flight_now();
+   r->type = type;
+   r->id = id;
+   r->a = a;
+   r->b = b;
+   if(name) strncpy(r->name, name, sizeof(r->name));
+   else     memset(r->name, 0, sizeof(r->name));
+}
+
+static void
+write_all(int fd, const void *data, size_t len)
+{
+   const char *p = data;
+   while(len > 0) {
+      ssize_t n = write(fd, p, len);
+      if(n <= 0) return;
+      p += n;
+      len -= n;
+   }
+}
+
+static void
+write_str(int fd, const char *s)
+{
+   write_all(fd, s, strlen(s));
+}
+
+void
+flight_dump(int sig)
+{
+   // async-signal-safe: open/write/close/clock_gettime only
+   if(!dump_path[0]) return;
+   if(sig) flight_record(FL_SIGNAL, 0, sig, 0, NULL);
+
+   int fd = open(dump_path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+   if(fd < 0) return;
+
+   uint64_t n = head < FLIGHT_RING_SIZE ? head : FLIGHT_RING_SIZE;
+   size_t first = (head - n) & (FLIGHT_RING_SIZE - 1);
+   struct flight_header header = {
+      .magic = FLIGHT_MAGIC,
+      .record_size = sizeof(struct flight_record),
+      .n_records = n,
+      .dump_ts = flight_now(),
+      .pid = getpid(),
+      .signal = sig,
+   };
+   write_all(fd, &header, sizeof(header));
+
+   // oldest first: the tail of the ring, then its start
+   size_t tail = MIN((size_t)n, FLIGHT_RING_SIZE - first);
+   write_all(fd, &ring[first], tail * sizeof(struct flight_record));
+   write_all(fd, &ring[0], (n - tail) * sizeof(struct flight_record));
+   close(fd);
+
+   write_str(STDERR_FILENO, "simplewc: flight recorder written to ");
+   write_str(STDERR_FILENO, dump_path);
+   write_str(STDERR_FILENO, "\n");
+}
+
+static void
+crash_handler(int sig)
+{
+   flight_dump(sig);
+
+   // SA_RESETHAND restored the default action: die with the original signal
+   raise(sig);
+}
+
+void
+flight_init()
+{
+   snprintf(dump_path, sizeof dump_path, "%s/simplewc-%d.flight", getenv("XDG_RUNTIME_DIR"), getpid());
+
+   // a stack overflow has no stack left to run the handler on
+   stack_t ss = { .ss_sp = alt_stack, .ss_size = sizeof alt_stack };
+   sigaltstack(&ss, NULL);
+
+   struct sigaction sa = { .sa_handler = crash_handler, .sa_flags = SA_ONSTACK | SA_RESETHAND };
+   sigemptyset(&sa.sa_mask);
+   for(int i=0; i<LENGTH(crash_signals); i++)
+      sigaction(crash_signals[i], &sa, NULL);
+}
@@ -26,6 +26,10 @@
 #include "client.h"
 #include "action.h"
 #include "input.h"
+#include "worker.h"
+#include "pool.h"
+
+POOL(tablet_tool_pool, simple_tablet_tool);
 
 
 //--- Pointer Constraints ------------------------------------------------
@@ -134,9 +138,13 @@ kb_modifiers_notify(struct wl_listener *listener, void *data)
 static void 
 kb_key_notify(struct wl_listener *listener, void *data) 
 {
+   WATCHDOG_SCOPE("kb_key");
    struct simple_input *keyboard = wl_container_of(listener, keyboard, kb_key);
    struct wlr_keyboard_key_event *event = data;
 
+   // keys pressed while the keymap is still being compiled are dropped
+   if(!keyboard->keyboard->keymap) return;
+
    uint32_t keycode = event->keycode + 8;
    const xkb_keysym_t *syms;
    //int nsyms = xkb_state_key_get_syms(keyboard->keyboard->xkb_state, keycode, &syms);
@@ -145,8 +153,16 @@ kb_key_notify(struct wl_listener *listener, void *data)
       keycode, layout_index, 0, &syms);
    
    bool handled = false;
+   int bound = 0;    // key function + 1 of the binding that matched
    uint32_t modifiers = wlr_keyboard_get_modifiers(keyboard->keyboard);
 
+   // key_dispatch(keycode, state, time_msec, focused client pid)
+   if(PROBE_ENABLED(key_dispatch)) {
+      struct simple_client *focused = NULL;
+      get_client_from_surface(g_server->seat->keyboard_state.focused_surface, &focused, NULL);
+      PROBE(key_dispatch, keycode, event->state, event->time_msec, focused ? get_client_pid(focused) : 0);
+   }
+
    wlr_idle_notifier_v1_notify_activity(g_server->idle_notifier, g_server->seat);
 
    if(event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
@@ -158,11 +174,17 @@ kb_key_notify(struct wl_listener *listener, void *data)
             if (syms[i] == keymap->keysym){
                key_function(keymap);
                handled=true;
+               bound = keymap->keyfn + 1;
             }
          }
       }
    }
 
+   // The flight recorder can be dumped by any IPC client: it gets the
+   // binding, never the key, and nothing at all on the lock screen.
+   if(!g_server->locked)
+      flight_record(FL_KEY, 0, bound, event->state, NULL);
+
    if(event->state == WL_KEYBOARD_KEY_STATE_RELEASED) {
       if(g_server->seat->keyboard_state.focused_surface){
          wlr_seat_set_keyboard(g_server->seat, keyboard->keyboard);
@@ -202,7 +224,6 @@ process_cursor_move(uint32_t time)
    if(client->geom.x==new_x && client->geom.y==new_y) return;
 
    //client->output = get_output_at(g_server->cursor->x, g_server->cursor->y);
-   //client->tag = client->output->current_tag;
    
    client->geom.x = new_x;
    client->geom.y = new_y;
@@ -263,6 +284,8 @@ process_cursor_motion(uint32_t time, struct wlr_input_device *device, double dx,
       double dx_unaccel, double dy_unaccel) 
 {
    //say(DEBUG, "process_cursor_motion");
+   WATCHDOG_SCOPE("cursor_motion");
+   PROBE(motion, time);
 
    double sx=0, sy=0, sx_confined, sy_confined;
    struct wlr_surface *surface = NULL;
@@ -360,7 +383,7 @@ process_cursor_button(uint32_t time, struct wlr_input_device *device, uint32_t b
             struct simple_output *test_output = get_output_at(g_server->cursor->x, g_server->cursor->y);
             if(test_output->wlr_output->enabled && test_output != client->output){
                client->output = test_output; 
-               client->tag = g_server->current_tag;
+               tagset_copy(&client->tag, &test_output->current_tag);
                return;
             }
          }
@@ -438,7 +461,9 @@ static void
 cursor_button_notify(struct wl_listener *listener, void *data) 
 {
    say(DEBUG, "cursor_button_notify");
+   WATCHDOG_SCOPE("cursor_button");
    struct wlr_pointer_button_event *event = data;
+   flight_record(FL_BUTTON, 0, event->button, event->state, NULL);
 
    wlr_idle_notifier_v1_notify_activity(g_server->idle_notifier, g_server->seat);
 
@@ -574,8 +599,10 @@ tablet_tool_destroy_notify(struct wl_listener *listener, void *data)
 {
    struct simple_tablet_tool *tool = wl_container_of(listener, tool, destroy);
 
+   wl_list_remove(&tool->link);
    wl_list_remove(&tool->destroy.link);
    wl_list_remove(&tool->set_cursor.link);
+   pool_free(&tablet_tool_pool, tool);
 }
 
 static void
@@ -583,7 +610,7 @@ tablet_tool_create(struct wlr_tablet_tool *wlr_tablet_tool, struct wlr_tablet_v2
 {
    say(DEBUG, "tablet_tool_create");
 
-   struct simple_tablet_tool *tool = calloc(1, sizeof(struct simple_tablet_tool));
+   struct simple_tablet_tool *tool = pool_alloc(&tablet_tool_pool);
    tool->tool_v2 = wlr_tablet_tool_create(g_server->tablet_manager, g_server->seat, wlr_tablet_tool);
    tool->tablet_v2 = tablet_v2;
    wlr_tablet_tool->data = tool;
@@ -726,6 +753,77 @@ tablet_tool_button_notify(struct wl_listener *listener, void *data)
    say(DEBUG, "cursor_tool_button_notify");
 }
 
+//--- Keymap -------------------------------------------------------------
+// The keymap is compiled once, on a worker thread, and shared by all keyboards.
+struct keymap_job {
+   char layout[32];
+   char options[32];
+   struct xkb_keymap *keymap;
+};
+
+static struct xkb_keymap *shared_keymap;
+static bool keymap_pending;
+
+static void
+keymap_compile(void *data)
+{
+   struct keymap_job *job = data;
+   struct xkb_rule_names rules = { 0 };
+   if(job->layout[0] != '\0')  rules.layout = job->layout;
+   if(job->options[0] != '\0') rules.options = job->options;
+
+   struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+   if(!context) return;
+   job->keymap = xkb_keymap_new_from_names(context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+   xkb_context_unref(context);
+}
+
+static void
+keyboard_apply_keymap(struct simple_input *input)
+{
+   wlr_keyboard_set_keymap(input->keyboard, shared_keymap);
+   wlr_keyboard_set_repeat_info(input->keyboard, 25, 600);
+   wlr_seat_set_keyboard(g_server->seat, input->keyboard);
+}
+
+static void
+keymap_done(void *data)
+{
+   struct keymap_job *job = data;
+   keymap_pending = false;
+
+   if(!(shared_keymap = job->keymap)) {
+      say(WARNING, "Unable to compile keymap (xkb_layout = %s, xkb_options = %s), using the default",
+            job->layout, job->options);
+      memset(job, 0, sizeof(*job));
+      keymap_compile(job);
+      if(!(shared_keymap = job->keymap)) say(ERROR, "Unable to compile the default keymap");
+   }
+   free(job);
+
+   struct simple_input *input;
+   wl_list_for_each(input, &g_server->inputs, link) {
+      if(input->type == INPUT_KEYBOARD && !input->keyboard->keymap)
+         keyboard_apply_keymap(input);
+   }
+}
+
+static void
+keyboard_request_keymap(struct simple_input *input)
+{
+   if(shared_keymap) {
+      keyboard_apply_keymap(input);
+      return;
+   }
+   if(keymap_pending) return;   // keymap_done() takes care of this keyboard too
+
+   struct keymap_job *job = calloc(1, sizeof(struct keymap_job));
+   snprintf(job->layout, sizeof job->layout, "%s", g_config->xkb_layout);
+   snprintf(job->options, sizeof job->options, "%s", g_config->xkb_options);
+   keymap_pending = true;
+   worker_submit(keymap_compile, keymap_done, job);
+}
+
 //--- Input notify function ----------------------------------------------
 static void 
 input_destroy_notify(struct wl_listener *listener, void *data) 
@@ -777,25 +875,8 @@ new_input_notify(struct wl_listener *listener, void *data)
       struct wlr_keyboard *kb = wlr_keyboard_from_input_device(device);
       input->keyboard = kb;
 
-      struct xkb_rule_names rules = { 0 };
-      if(g_config->xkb_layout[0] != '\0')
-         rules.layout = g_config->xkb_layout;
-      if(g_config->xkb_options[0] != '\0')
-         rules.options = g_config->xkb_options;
-
-      struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-      struct xkb_keymap *keymap = xkb_map_new_from_names(context, &rules, 
-            XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-      wlr_keyboard_set_keymap(kb, keymap);
-      xkb_keymap_unref(keymap);
-      xkb_context_unref(context);
-      wlr_keyboard_set_repeat_info(kb, 25, 600);
-
       LISTEN(&kb->events.modifiers, &input->kb_modifiers, kb_modifiers_notify);
       LISTEN(&kb->events.key, &input->kb_key, kb_key_notify);
-      
-      wlr_seat_set_keyboard(g_server->seat, kb);
    } else if (device->type == WLR_INPUT_DEVICE_TABLET) {
       say(DEBUG, "New Input: TABLET");
       input->type = INPUT_TABLET; 
@@ -829,6 +910,9 @@ new_input_notify(struct wl_listener *listener, void *data)
    LISTEN(&device->events.destroy, &input->destroy, input_destroy_notify);
    wl_list_insert(&g_server->inputs, &input->link);
 
+   // the seat gets the keyboard once it has a keymap
+   if(input->type == INPUT_KEYBOARD) keyboard_request_keymap(input);
+
    uint32_t caps = 0;
    wl_list_for_each(input, &g_server->inputs, link) {
       switch (input->device->type){
@@ -892,3 +976,11 @@ input_init()
    wlr_input_method_manager_v2_create(g_server->display);
    wlr_text_input_manager_v3_create(g_server->display);
 }
+
+void
+input_finish()
+{
+   // called after worker_finish(); the keyboards hold their own keymap references
+   xkb_keymap_unref(shared_keymap);
+   shared_keymap = NULL;
+}
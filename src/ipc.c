@@ -1,5 +1,8 @@
+#include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 #include <wlr/backend/session.h>
+#include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_cursor.h>
 
 #include "dwl-ipc-unstable-v2-protocol.h"
@@ -8,8 +11,13 @@
 #include "client.h"
 #include "server.h"
 #include "output.h"
+#include "log.h"
 #include "action.h"
 #include "ipc.h"
+#include "launch.h"
+#include "pool.h"
+
+POOL(ipc_output_pool, simple_ipc_output);
 
 static void ipc_manager_release(struct wl_client *, struct wl_resource *);
 static void ipc_manager_get_output(struct wl_client *, struct wl_resource *, uint32_t, struct wl_resource *);
@@ -61,13 +69,55 @@ ipc_output_printstatus(struct simple_output *output)
 		ipc_output_printstatus_to(ipc_output);
 }
 
+static const struct {
+   const char *name;
+   void (*write)(FILE*);
+} reports[] = {
+   { "frames",    output_report_frames },
+   { "listeners", profile_report },
+   { "log",       log_report },
+   { "watchdog",  watchdog_report },
+   { "launches",  launch_report },
+   { "clients",   client_report },
+   { "pools",     pool_report },
+};
+
+void
+ipc_report(const char *name)
+{
+   // There is no reply channel in dwl-ipc, so reports are written to
+   // $XDG_RUNTIME_DIR/simplewc-<name>.report. The name comes from any IPC
+   // client: only the known reports are written, never through a symlink.
+   unsigned int r = 0;
+   while(r < LENGTH(reports) && strcmp(name, reports[r].name)) r++;
+   if(r == LENGTH(reports)) {
+      say(WARNING, "Unknown report '%s'", name);
+      return;
+   }
+
+   char path[256];
+   snprintf(path, sizeof path, "%s/simplewc-%s.report", getenv("XDG_RUNTIME_DIR"), name);
+
+   int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+   FILE *f = fd < 0 ? NULL : fdopen(fd, "w");
+   if(!f) {
+      if(fd >= 0) close(fd);
+      say(WARNING, "Unable to write report %s", path);
+      return;
+   }
+
+   reports[r].write(f);
+   fclose(f);
+   say(INFO, "Report written to %s", path);
+}
+
 //--- IPC manager implementation -----------------------------------------
 static void
 ipc_output_destroy(struct wl_resource *resource)
 {
 	struct simple_ipc_output *ipc_output = wl_resource_get_user_data(resource);
 	wl_list_remove(&ipc_output->link);
-	free(ipc_output);
+	pool_free(&ipc_output_pool, ipc_output);
 }
 
 void
@@ -86,7 +136,7 @@ ipc_manager_get_output(struct wl_client *client, struct wl_resource *resource, u
 	if (!output_resource)
 		return;
 
-	ipc_output = calloc(1, sizeof(*ipc_output));
+	ipc_output = pool_alloc(&ipc_output_pool);
 	ipc_output->resource = output_resource;
  	ipc_output->output = sop;
 	wl_resource_set_implementation(output_resource, &ipc_output_implementation, ipc_output, ipc_output_destroy);
@@ -99,6 +149,9 @@ void
 ipc_manager_send_action(struct wl_client *client, struct wl_resource *resource, const char* action)
 {
    say(INFO, "ipc_output_send_action: %s", action);
+   WATCHDOG_SCOPE("ipc_action");
+   PROBE(ipc_action, action);
+   flight_record(FL_IPC, 0, 0, 0, action);
    process_ipc_action(action);
 }
 
@@ -108,36 +161,42 @@ ipc_output_printstatus_to(struct simple_ipc_output *ipc_output)
 {
 	struct simple_output *output = ipc_output->output;
 	struct simple_client *c, *focused;
-	int tagmask, state, numclients, focused_client, tag;
+	int tag;
    char *title;
+   struct {
+      uint32_t state;
+      uint32_t numclients;
+      bool focused_client;
+   } *tags;
 	
    focused = get_top_client_from_output(output, false);
 	zdwl_ipc_output_v2_send_active(ipc_output->resource, output == g_server->cur_output);
 
    ///////////////////////////////////////////
-//   struct simple_output *test_output; 
-   for (tag = 0 ; tag < g_config->n_tags; tag++) {
-      numclients = state = focused_client = 0;
-      tagmask = 1 << tag;
-      //wl_list_for_each(test_output, &g_server->outputs, link) {
-         if ((tagmask & g_server->visible_tags) != 0)
-            state |= ZDWL_IPC_OUTPUT_V2_TAG_STATE_ACTIVE;
-      //}
-
-      wl_list_for_each(c, &g_server->clients, link) {
-         //if (c->output != output)
-         //   continue;
-         if (!(c->tag & tagmask))
-            continue;
+   // one pass over the clients, visiting only the tags each one is on
+   if(!(tags = calloc(g_config->n_tags, sizeof(*tags)))) return;
+
+   tagset_for_each(tag, &output->visible_tags) {
+      if (tag >= g_config->n_tags) break;
+      tags[tag].state |= ZDWL_IPC_OUTPUT_V2_TAG_STATE_ACTIVE;
+   }
+
+   wl_list_for_each(c, &g_server->clients, link) {
+      if (c->output != output)
+         continue;
+      tagset_for_each(tag, &c->tag) {
+         if (tag >= g_config->n_tags) break;
          if (c == focused)
-            focused_client = 1;
+            tags[tag].focused_client = true;
          if (c->urgent)
-            state |= ZDWL_IPC_OUTPUT_V2_TAG_STATE_URGENT;
-
-         numclients++;
+            tags[tag].state |= ZDWL_IPC_OUTPUT_V2_TAG_STATE_URGENT;
+         tags[tag].numclients++;
       }
-      zdwl_ipc_output_v2_send_tag(ipc_output->resource, tag, state, numclients, focused_client);
-	}
+   }
+
+   for (tag = 0 ; tag < g_config->n_tags; tag++)
+      zdwl_ipc_output_v2_send_tag(ipc_output->resource, tag, tags[tag].state, tags[tag].numclients, tags[tag].focused_client);
+   free(tags);
 	title = focused ? get_client_title(focused) : "";
 //	appid = focused ? get_client_appid(focused) : "";
    ////////////////////////////////////////////////
@@ -151,6 +210,7 @@ ipc_output_printstatus_to(struct simple_ipc_output *ipc_output)
 	//	zdwl_ipc_output_v2_send_floating(ipc_output->resource, focused ? focused->isfloating : 0);
 	//}
 	zdwl_ipc_output_v2_send_frame(ipc_output->resource);
+	PROBE(ipc_send, output->wlr_output->name);
 }
 
 void
@@ -166,8 +226,11 @@ ipc_output_set_client_tags(struct wl_client *client, struct wl_resource *resourc
 	struct simple_ipc_output *ipc_output;
 	struct simple_output *output;
 	struct simple_client *selected_client;
-	uint32_t newtags = 0;
+	struct tagset newtags = {0};
 
+	TRACE_SCOPE("ipc_set_client_tags");
+	WATCHDOG_SCOPE("ipc_set_client_tags");
+	flight_record(FL_IPC, 0, and_tags, xor_tags, "clt_tags");
 	ipc_output = wl_resource_get_user_data(resource);
 	if (!ipc_output) return;
 
@@ -175,44 +238,51 @@ ipc_output_set_client_tags(struct wl_client *client, struct wl_resource *resourc
 	selected_client = get_top_client_from_output(output, false);
 	if (!selected_client) return;
 
-	newtags = (selected_client->tag & and_tags) ^ xor_tags;
-	if (!newtags) return;
+   // dwl-ipc masks only reach the first 32 tags, the others are kept
+   tagset_copy(&newtags, &selected_client->tag);
+   tagset_apply_mask32(&newtags, and_tags, xor_tags);
+   tagset_limit(&newtags, g_config->n_tags);
+	if (tagset_empty(&newtags)) {
+      tagset_finish(&newtags);
+      return;
+   }
 
+   tagset_finish(&selected_client->tag);
 	selected_client->tag = newtags;
-	arrange_outputs();
-	print_server_info();
+	arrange_output(output);
+	ipc_output_printstatus(output);
 }
 
 void
 ipc_output_set_tags(struct wl_client *client, struct wl_resource *resource, uint32_t tagmask, uint32_t toggle_tagset)
 {
 	struct simple_ipc_output *ipc_output;
-   struct simple_output *output;
-//	struct simple_output *test_output;
-	//unsigned int newtags = tagmask;
-	unsigned int newtags = tagmask & ((1 << g_config->n_tags) -1 );
- //  unsigned int test_tagmask=0;
+   struct simple_output *output, *prev_output;
+	struct tagset newtags = { .word = tagmask };
+	TRACE_SCOPE("ipc_set_tags");
+	WATCHDOG_SCOPE("ipc_set_tags");
+	flight_record(FL_IPC, 0, tagmask, toggle_tagset, "set_tags");
+   tagset_limit(&newtags, g_config->n_tags);
 
 	ipc_output = wl_resource_get_user_data(resource);
 	if (!ipc_output) return;
 
 	if(!(output = ipc_output->output)) return;
+   prev_output = g_server->cur_output;
    g_server->cur_output = output;
 
-	if (!newtags || newtags == g_server->visible_tags) return;
+	if (tagset_empty(&newtags) || tagset_equal(&newtags, &output->visible_tags)) return;
 
-   if(toggle_tagset) {
-      //wl_list_for_each(test_output, &g_server->outputs, link) {
-      //   if(test_output==output) continue;
-      //   test_tagmask |= test_output->visible_tags;
-      //}
-      //if(newtags & test_tagmask) return; // don't do anything if tag is visible on other outputs
+   if(toggle_tagset)
+      tagset_copy(&output->current_tag, &newtags);
 
-      g_server->current_tag = newtags;
-   }
+	tagset_copy(&output->visible_tags, &newtags);
+	arrange_output(output);
 
-	g_server->visible_tags = newtags;
-	arrange_outputs();
-	print_server_info();
+   // the active flag moved too if the request came from another output
+   if(prev_output != output)
+      print_server_info();
+   else
+      ipc_output_printstatus(output);
 }
 
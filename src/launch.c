@@ -0,0 +1,335 @@
+/*
+ * launch.c
+ *   - Launch-to-first-frame latency
+ *
+ * spawn() opens a launch and gives the child an xdg-activation token in
+ * XDG_ACTIVATION_TOKEN. A new toplevel is matched to an open launch on its first
+ * commit (X11: on map) by its pid, or by the pid of a spawned parent such as
+ * "sh -c", or later when it activates with the token. Each client keeps the times
+ * of its first commit, map and first frame, so a late match loses nothing.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <wlr/types/wlr_xdg_activation_v1.h>
+
+#include "globals.h"
+#include "client.h"
+#include "output.h"
+#include "server.h"
+#include "launch.h"
+
+#define LAUNCH_TIMEOUT     60000000000ull  // ns, give up on a window after this
+#define LAUNCH_BUCKETS     16              // hist[i]: spawn to frame in [2^(i-1), 2^i) ms
+#define LAUNCH_RECENT      32
+#define LAUNCH_PARENTS     4               // levels of parent processes searched
+
+enum LaunchMatch { MATCH_NONE, MATCH_PID, MATCH_PARENT, MATCH_TOKEN };
+static const char *match_str[] = { "-", "pid", "parent", "token" };
+
+struct launch {
+   struct wl_list link;
+   char *cmd;
+   pid_t pid;
+   uint64_t spawn;
+
+   struct wlr_xdg_activation_token_v1 *token;
+   struct wl_listener token_destroy;
+
+   struct simple_client *client;
+   enum LaunchMatch match;
+};
+
+// per command
+struct launch_stats {
+   struct wl_list link;
+   char *cmd;
+   uint64_t launches, windows, timeouts;
+   uint64_t total_ns, max_ns;       // spawn to first frame
+   uint64_t hist[LAUNCH_BUCKETS];
+};
+
+struct launch_record {
+   char cmd[48];
+   char app_id[32];
+   pid_t pid;
+   enum LaunchMatch match;
+   uint64_t commit, map, frame;     // ns after spawn, 0 when it did not happen
+};
+
+static struct wl_list launches = { &launches, &launches };
+static struct wl_list stats = { &stats, &stats };
+static struct launch_record recent[LAUNCH_RECENT];
+static uint64_t n_recent;
+static int frames_pending;         // mapped launch clients still waiting for a frame
+
+static uint64_t
+now_ns()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct launch_stats*
+stats_get(const char *cmd)
+{
+   struct launch_stats *s;
+   wl_list_for_each(s, &stats, link) {
+      if(!strcmp(s->cmd, cmd)) return s;
+   }
+
+   s = calloc(1, sizeof(struct launch_stats));
+   s->cmd = strdup(cmd);
+   wl_list_insert(stats.prev, &s->link);
+   return s;
+}
+
+static void
+launch_free(struct launch *launch)
+{
+   if(launch->token) {
+      wl_list_remove(&launch->token_destroy.link);
+      launch->token->data = NULL;
+   }
+   if(launch->client) launch->client->launch = NULL;
+   wl_list_remove(&launch->link);
+   free(launch->cmd);
+   free(launch);
+}
+
+static void
+launch_complete(struct launch *launch)
+{
+   // the window is on screen (or gone): record it and close the launch
+   struct simple_client *client = launch->client;
+   struct launch_stats *s = stats_get(launch->cmd);
+   s->windows++;
+
+   struct launch_record *r = &recent[n_recent++ % LAUNCH_RECENT];
+   memset(r, 0, sizeof(*r));
+   snprintf(r->cmd, sizeof r->cmd, "%s", launch->cmd);
+   snprintf(r->app_id, sizeof r->app_id, "%s", get_client_appid(client) ? get_client_appid(client) : "");
+   r->pid = get_client_pid(client);
+   r->match = launch->match;
+   if(client->commit_ns)  r->commit = client->commit_ns - launch->spawn;
+   if(client->map_ns)     r->map = client->map_ns - launch->spawn;
+   if(client->frame_ns)   r->frame = client->frame_ns - launch->spawn;
+
+   if(r->frame) {
+      s->total_ns += r->frame;
+      if(r->frame > s->max_ns) s->max_ns = r->frame;
+      uint64_t ms = r->frame / 1000000;
+      int bucket = ms ? 64 - __builtin_clzll(ms) : 0;
+      s->hist[MIN(bucket, LAUNCH_BUCKETS-1)]++;
+   }
+
+   say(DEBUG, "launch %s: commit %.1f ms, map %.1f ms, first frame %.1f ms (matched by %s)",
+         launch->cmd, r->commit/1e6, r->map/1e6, r->frame/1e6, match_str[r->match]);
+   launch_free(launch);
+}
+
+static void
+launch_expire()
+{
+   uint64_t now = now_ns();
+   struct launch *launch, *tmp;
+   wl_list_for_each_safe(launch, tmp, &launches, link) {
+      if(launch->client || now - launch->spawn < LAUNCH_TIMEOUT) continue;
+      stats_get(launch->cmd)->timeouts++;
+      launch_free(launch);
+   }
+}
+
+static pid_t
+parent_pid(pid_t pid)
+{
+   char path[64], buffer[512];
+   snprintf(path, sizeof path, "/proc/%d/stat", pid);
+   FILE *f = fopen(path, "r");
+   if(!f) return 0;
+   size_t n = fread(buffer, 1, sizeof buffer - 1, f);
+   fclose(f);
+   buffer[n] = '\0';
+
+   // "pid (comm) state ppid ...", comm may contain anything
+   char *end = strrchr(buffer, ')');
+   int ppid = 0;
+   if(!end || sscanf(end + 1, " %*c %d", &ppid) != 1) return 0;
+   return ppid;
+}
+
+static void
+launch_attach(struct launch *launch, struct simple_client *client, enum LaunchMatch match)
+{
+   launch->client = client;
+   launch->match = match;
+   client->launch = launch;
+   if(client->frame_ns) launch_complete(launch);
+}
+
+static void
+launch_match_pid(struct simple_client *client)
+{
+   if(client->launch || wl_list_empty(&launches)) return;
+
+   pid_t pid = get_client_pid(client);
+   for(int level=0; pid > 1 && level<=LAUNCH_PARENTS; level++) {
+      struct launch *launch;
+      wl_list_for_each(launch, &launches, link) {
+         if(launch->client || launch->pid != pid) continue;
+         launch_attach(launch, client, level ? MATCH_PARENT : MATCH_PID);
+         return;
+      }
+      pid = parent_pid(pid);
+   }
+}
+
+static void
+token_destroy_notify(struct wl_listener *listener, void *data)
+{
+   struct launch *launch = wl_container_of(listener, launch, token_destroy);
+   wl_list_remove(&launch->token_destroy.link);
+   launch->token = NULL;
+}
+
+//------------------------------------------------------------------------
+struct launch*
+launch_begin(const char *cmd)
+{
+   launch_expire();
+
+   struct launch *launch = calloc(1, sizeof(struct launch));
+   launch->cmd = strdup(cmd);
+   launch->spawn = now_ns();
+   wl_list_insert(&launches, &launch->link);
+
+   if(g_server->xdg_activation
+         && (launch->token = wlr_xdg_activation_token_v1_create(g_server->xdg_activation))) {
+      launch->token->data = launch;
+      LISTEN(&launch->token->events.destroy, &launch->token_destroy, token_destroy_notify);
+   }
+   return launch;
+}
+
+const char*
+launch_token(struct launch *launch)
+{
+   return launch->token ? wlr_xdg_activation_token_v1_get_name(launch->token) : NULL;
+}
+
+void
+launch_started(struct launch *launch, pid_t pid)
+{
+   if(pid <= 0) {
+      launch_free(launch);
+      return;
+   }
+   launch->pid = pid;
+   stats_get(launch->cmd)->launches++;
+}
+
+void
+launch_client_commit(struct simple_client *client)
+{
+   if(client->commit_ns) return;
+   client->commit_ns = now_ns();
+   launch_match_pid(client);
+}
+
+void
+launch_client_map(struct simple_client *client)
+{
+   if(client->map_ns) return;
+   client->map_ns = now_ns();
+   if(!client->commit_ns) client->commit_ns = client->map_ns; // X11 windows map with a buffer
+   client->frame_pending = true;
+   frames_pending++;
+   launch_match_pid(client);
+}
+
+void
+launch_client_unmap(struct simple_client *client)
+{
+   if(client->frame_pending) {
+      client->frame_pending = false;
+      frames_pending--;
+   }
+   // unmapped before its first frame: record what there is
+   if(client->launch) launch_complete(client->launch);
+}
+
+void
+launch_activate(struct wlr_xdg_activation_token_v1 *token, struct simple_client *client)
+{
+   struct launch *launch = token ? token->data : NULL;
+   if(!launch || !client || client->launch || launch->client) return;
+   launch_attach(launch, client, MATCH_TOKEN);
+}
+
+void
+launch_output_frame(struct simple_output *output)
+{
+   if(!frames_pending) return;
+
+   uint64_t now = now_ns();
+   struct simple_client *client;
+   wl_list_for_each(client, &g_server->clients, link) {
+      if(!client->frame_pending || client->output != output) continue;
+      client->frame_pending = false;
+      client->frame_ns = now;
+      frames_pending--;
+      if(client->launch) launch_complete(client->launch);
+   }
+}
+
+void
+launch_report(FILE *f)
+{
+   launch_expire();
+
+   fprintf(f, "%-32s %8s %8s %8s %10s %10s  histogram (spawn to first frame, <ms:count)\n",
+         "command", "launches", "windows", "timeouts", "avg[ms]", "max[ms]");
+   struct launch_stats *s;
+   wl_list_for_each(s, &stats, link) {
+      uint64_t timed = 0;
+      for(int b=0; b<LAUNCH_BUCKETS; b++) timed += s->hist[b];
+      fprintf(f, "%-32.32s %8llu %8llu %8llu %10.1f %10.1f ", s->cmd, (unsigned long long)s->launches,
+            (unsigned long long)s->windows, (unsigned long long)s->timeouts,
+            timed ? s->total_ns/1e6/timed : 0., s->max_ns/1e6);
+      for(int b=0; b<LAUNCH_BUCKETS; b++) {
+         if(s->hist[b]) fprintf(f, " %llu:%llu", 1ull << b, (unsigned long long)s->hist[b]);
+      }
+      fprintf(f, "\n");
+   }
+
+   fprintf(f, "\nrecent launches (ms after spawn)\n");
+   fprintf(f, "%-32s %-20s %8s %-7s %10s %10s %10s\n", "command", "app_id", "pid", "match", "commit", "map", "frame");
+   uint64_t first = n_recent > LAUNCH_RECENT ? n_recent - LAUNCH_RECENT : 0;
+   for(uint64_t i=first; i<n_recent; i++) {
+      struct launch_record *r = &recent[i % LAUNCH_RECENT];
+      fprintf(f, "%-32.32s %-20.20s %8d %-7s %10.1f %10.1f %10.1f\n", r->cmd, r->app_id, r->pid,
+            match_str[r->match], r->commit/1e6, r->map/1e6, r->frame/1e6);
+   }
+
+   struct launch *launch;
+   wl_list_for_each(launch, &launches, link) {
+      fprintf(f, "%-32.32s waiting for a window for %.1f s (pid %d)\n", launch->cmd,
+            (now_ns() - launch->spawn)/1e9, launch->pid);
+   }
+}
+
+void
+launch_finish()
+{
+   struct launch *launch, *tmp;
+   wl_list_for_each_safe(launch, tmp, &launches, link)
+      launch_free(launch);
+
+   struct launch_stats *s, *stmp;
+   wl_list_for_each_safe(s, stmp, &stats, link) {
+      wl_list_remove(&s->link);
+      free(s->cmd);
+      free(s);
+   }
+}
@@ -12,6 +12,10 @@
 #include "client.h"
 #include "server.h"
 #include "output.h"
+#include "popup.h"
+#include "pool.h"
+
+POOL(layer_pool, simple_layer_surface);
 
 static const int layermap[] = {LyrBg, LyrBottom, LyrTop, LyrOverlay };
 
@@ -35,6 +39,7 @@ arrange_layer(struct simple_output *output, struct wl_list *list, struct wlr_box
       wlr_scene_node_set_position(&surface->popups->node, surface->scene_tree->node.x, surface->scene_tree->node.y);
       surface->geom.x = surface->scene_tree->node.x;
       surface->geom.y = surface->scene_tree->node.y;
+      popup_unconstrain_children(NULL, surface);
    }
 }
 
@@ -42,6 +47,8 @@ void
 arrange_layers(struct simple_output *output)
 {
    say(DEBUG, "arrange_layers");
+   TRACE_SCOPE("arrange_layers");
+   PROBE(layer_arrange, output->wlr_output->name);
 
    //struct wlr_box full_area = { 0 };
    //wlr_output_effective_resolution(output->wlr_output, &full_area.width, &full_area.height);
@@ -72,6 +79,37 @@ arrange_layers(struct simple_output *output)
    }
 }
 
+static void
+arrange_layers_idle_notify(void *data)
+{
+   WATCHDOG_SCOPE("arrange_layers");
+   struct simple_output *output = data;
+   output->arrange_layers_idle = NULL;
+   arrange_layers(output);
+}
+
+void
+schedule_arrange_layers(struct simple_output *output)
+{
+   // all layer surfaces of an output committing in the same loop iteration
+   // (e.g. a bar with several widgets) share one arrange
+   if(output->arrange_layers_idle) return;
+   output->arrange_layers_idle = 
+      wl_event_loop_add_idle(g_server->event_loop, arrange_layers_idle_notify, output);
+}
+
+static bool
+layer_state_changed(const struct wlr_layer_surface_v1_state *a, const struct wlr_layer_surface_v1_state *b)
+{
+   return a->anchor != b->anchor
+      || a->exclusive_zone != b->exclusive_zone
+      || a->margin.top != b->margin.top || a->margin.right != b->margin.right
+      || a->margin.bottom != b->margin.bottom || a->margin.left != b->margin.left
+      || a->desired_width != b->desired_width || a->desired_height != b->desired_height
+      || a->layer != b->layer
+      || a->keyboard_interactive != b->keyboard_interactive;
+}
+
 //--- Notify functions ---------------------------------------------------
 /*
 static void 
@@ -95,7 +133,7 @@ layer_surface_unmap_notify(struct wl_listener *listener, void *data)
    wlr_scene_node_set_enabled(&lsurface->scene_tree->node, 0);
 
    if(wlr_lsurface->output && (lsurface->output = wlr_lsurface->output->data))
-      arrange_layers(lsurface->output);
+      schedule_arrange_layers(lsurface->output);
 }
 
 static void 
@@ -119,12 +157,27 @@ layer_surface_commit_notify(struct wl_listener *listener, void *data)
       wl_list_insert(&lsurface->output->layer_shells[wlr_lsurface->current.layer], &lsurface->link);
    }
 
-   if(wlr_lsurface->current.committed==0 && lsurface->mapped == wlr_lsurface->surface->mapped)
+   // buffer-only commits (clocks, graphs) do not change the layout
+   bool map_changed = lsurface->mapped != wlr_lsurface->surface->mapped;
+   bool initial = wlr_lsurface->initial_commit;
+   if(!initial && !map_changed && !layer_state_changed(&wlr_lsurface->current, &lsurface->last_state))
       return;
+
+   bool kb_changed = initial || map_changed || 
+      wlr_lsurface->current.keyboard_interactive != lsurface->last_state.keyboard_interactive;
    lsurface->mapped = wlr_lsurface->surface->mapped;
+   lsurface->last_state = wlr_lsurface->current;
 
-   arrange_layers(lsurface->output);
-   input_focus_surface(lsurface->scene_layer_surface->layer_surface->surface);
+   schedule_arrange_layers(lsurface->output);
+
+   if(!kb_changed || !lsurface->mapped) return;
+
+   // only surfaces asking for the keyboard take focus
+   struct wlr_surface *surface = wlr_lsurface->surface;
+   if(wlr_lsurface->current.keyboard_interactive != ZWLR_LAYER_SURFACE_V1_KEYBOARD_INTERACTIVITY_NONE)
+      input_focus_surface(surface);
+   else if(g_server->seat->keyboard_state.focused_surface == surface)
+      focus_client(get_top_client_from_output(lsurface->output, false), true);
 }
 
 static void 
@@ -140,7 +193,8 @@ layer_surface_destroy_notify(struct wl_listener *listener, void *data)
    wl_list_remove(&lsurface->unmap.link);
    wl_list_remove(&lsurface->surface_commit.link);
    //wlr_scene_node_destroy(&lsurface->scene_tree->node);
-   free(lsurface);
+   popup_owner_destroy(NULL, lsurface);
+   pool_free(&layer_pool, lsurface);
 
    focus_client(get_top_client_from_output(output, false), true);
 }
@@ -160,7 +214,7 @@ layer_new_surface_notify(struct wl_listener *listener, void *data)
    struct simple_output *output = layer_surface->output->data;
    struct wlr_scene_tree *selected_layer = g_server->layer_tree[layermap[layer_surface->pending.layer]];
 
-   struct simple_layer_surface *lsurface = calloc(1, sizeof(struct simple_layer_surface));
+   struct simple_layer_surface *lsurface = pool_alloc(&layer_pool);
    lsurface->type = LAYER_SHELL_CLIENT;
    lsurface->output = output;
 
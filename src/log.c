@@ -0,0 +1,462 @@
+/*
+ * log.c
+ *   - Asynchronous logger
+ *
+ * say() on the main thread only captures its arguments into a slot of a
+ * single-producer/single-consumer ring. Format strings are literals, so the pointer
+ * is kept and the arguments are read by walking the format once; strings are copied
+ * into the slot. A writer thread does the formatting and the I/O, so a slow stderr
+ * or disk no longer stalls the event loop. When the ring is full records are dropped
+ * and counted.
+ *
+ * Other threads (watchdog, workers) log rarely: they format on their own stack and
+ * write to the same output under the lock the writer holds while it drains.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <wlr/util/log.h>
+
+#include "globals.h"
+#include "log.h"
+
+#define CRED      "\033[31m"
+#define CBLUE     "\033[34m"
+#define CYELLOW   "\033[33m"
+#define CRESET    "\033[0m"
+
+#define LOG_RING_SIZE   1024     // slots, power of 2
+#define LOG_MAX_ARGS    12
+#define LOG_DATA_SIZE   384      // inline strings / preformatted text
+#define LOG_ROTATE_KEEP 3
+
+static const char *msg_str[NMSG] = { CBLUE"DEBUG"CRESET, "INFO", CYELLOW"WARNING"CRESET, CRED"ERROR"CRESET };
+static const char *msg_plain[NMSG] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+
+enum LogArgType {
+   ARG_INT, ARG_LONG, ARG_LLONG, ARG_SIZE, ARG_INTMAX, ARG_PTRDIFF,
+   ARG_DOUBLE, ARG_LDOUBLE, ARG_STR, ARG_PTR
+};
+
+struct log_arg {
+   uint8_t type;
+   union {
+      long long i;
+      long double ld;
+      double d;
+      const void *p;
+      uint16_t str;     // offset in data
+   };
+};
+
+struct log_record {
+   uint64_t ts;               // ns since log_init (CLOCK_MONOTONIC)
+   const char *fmt;           // NULL: data holds preformatted text (wlroots)
+   uint8_t level;
+   uint8_t nargs;
+   uint16_t data_len;
+   struct log_arg args[LOG_MAX_ARGS];
+   char data[LOG_DATA_SIZE];
+};
+
+static struct {
+   struct log_record ring[LOG_RING_SIZE];
+   _Atomic size_t head, tail;
+   _Atomic uint64_t dropped;
+   uint64_t dropped_reported;
+   sem_t wake;
+
+   pthread_t writer, producer;
+   atomic_bool running;
+   uint64_t start;
+
+   pthread_mutex_t lock;      // out, written: writer thread and other threads
+   FILE *out;
+   bool colour;
+   size_t written;
+   size_t max_size;
+} log_state = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static inline uint64_t
+log_now()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//--- Capture (main thread) ----------------------------------------------
+static size_t
+copy_str(struct log_record *rec, const char *str)
+{
+   // once data is full, later strings all point at its last byte: ""
+   size_t off = rec->data_len;
+   if(off >= LOG_DATA_SIZE - 1) {
+      rec->data[LOG_DATA_SIZE - 1] = '\0';
+      return LOG_DATA_SIZE - 1;
+   }
+   if(!str) str = "(null)";
+   size_t len = strnlen(str, LOG_DATA_SIZE - 1 - off);
+   memcpy(rec->data + off, str, len);
+   rec->data[off + len] = '\0';
+   rec->data_len = off + len + 1;
+   return off;
+}
+
+static void
+capture_args(struct log_record *rec, const char *fmt, va_list args, int saved_errno)
+{
+   for(const char *c = fmt; *c && rec->nargs < LOG_MAX_ARGS; c++) {
+      if(*c != '%') continue;
+      if(*++c == '%') continue;
+      if(!*c) break;
+
+      while(*c && strchr("-+ #0'", *c)) c++;
+      if(*c == '*') { rec->args[rec->nargs++] = (struct log_arg){ .type = ARG_INT, .i = va_arg(args, int) }; c++; }
+      else while(*c >= '0' && *c <= '9') c++;
+      if(*c == '.') {
+         c++;
+         if(*c == '*') { rec->args[rec->nargs++] = (struct log_arg){ .type = ARG_INT, .i = va_arg(args, int) }; c++; }
+         else while(*c >= '0' && *c <= '9') c++;
+      }
+      if(rec->nargs >= LOG_MAX_ARGS) break;
+
+      int length = 0; // 'l', 'L' (ll), 'z', 'j', 't', 'D' (long double)
+      while(*c && strchr("hlLqzjt", *c)) {
+         if(*c == 'l') length = length=='l' ? 'L' : 'l';
+         else if(*c == 'q') length = 'L';
+         else if(*c == 'L') length = 'D';
+         else if(*c != 'h') length = *c;
+         c++;
+      }
+
+      struct log_arg *arg = &rec->args[rec->nargs];
+      switch(*c) {
+         case 'd': case 'i': case 'c':
+         case 'o': case 'u': case 'x': case 'X': case 'b': case 'B':
+            switch(length) {
+               case 'l': arg->type = ARG_LONG;    arg->i = va_arg(args, long); break;
+               case 'L': arg->type = ARG_LLONG;   arg->i = va_arg(args, long long); break;
+               case 'z': arg->type = ARG_SIZE;    arg->i = va_arg(args, size_t); break;
+               case 'j': arg->type = ARG_INTMAX;  arg->i = va_arg(args, intmax_t); break;
+               case 't': arg->type = ARG_PTRDIFF; arg->i = va_arg(args, ptrdiff_t); break;
+               default:  arg->type = ARG_INT;     arg->i = va_arg(args, int); break;
+            }
+            break;
+         case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            if(length == 'D') { arg->type = ARG_LDOUBLE; arg->ld = va_arg(args, long double); }
+            else              { arg->type = ARG_DOUBLE;  arg->d = va_arg(args, double); }
+            break;
+         case 's':
+            arg->type = ARG_STR;
+            arg->str = copy_str(rec, va_arg(args, const char*));
+            break;
+         case 'm':
+            // glibc %m: errno at the time of the call, captured as a string
+            arg->type = ARG_STR;
+            arg->str = copy_str(rec, strerror(saved_errno));
+            break;
+         case 'p': case 'n':
+            arg->type = ARG_PTR;
+            arg->p = va_arg(args, void*);
+            break;
+         default:
+            return; // malformed, format what we have
+      }
+      rec->nargs++;
+   }
+}
+
+static bool
+log_push(int level, const char *fmt, va_list args, bool preformatted)
+{
+   int saved_errno = errno;
+   size_t head = atomic_load_explicit(&log_state.head, memory_order_relaxed);
+   size_t tail = atomic_load_explicit(&log_state.tail, memory_order_acquire);
+
+   // errors are about to terminate the compositor: wait for room rather than drop them
+   while(level == ERROR && head - tail >= LOG_RING_SIZE) {
+      sched_yield();
+      tail = atomic_load_explicit(&log_state.tail, memory_order_acquire);
+   }
+   if(head - tail >= LOG_RING_SIZE) {
+      atomic_fetch_add_explicit(&log_state.dropped, 1, memory_order_relaxed);
+      return false;
+   }
+
+   struct log_record *rec = &log_state.ring[head & (LOG_RING_SIZE - 1)];
+   rec->ts = log_now() - log_state.start;
+   rec->level = level;
+   rec->nargs = 0;
+   rec->data_len = 0;
+   if(preformatted) {
+      rec->fmt = NULL;
+      vsnprintf(rec->data, sizeof rec->data, fmt, args);
+   } else {
+      rec->fmt = fmt;
+      capture_args(rec, fmt, args, saved_errno);
+   }
+
+   atomic_store_explicit(&log_state.head, head + 1, memory_order_release);
+   sem_post(&log_state.wake);
+   return true;
+}
+
+//--- Formatting (writer thread) -----------------------------------------
+#define FORMAT_ARG(T, V) \
+   (nstar==0 ? snprintf(out, len, spec, (T)(V)) : \
+    nstar==1 ? snprintf(out, len, spec, star[0], (T)(V)) : \
+               snprintf(out, len, spec, star[0], star[1], (T)(V)))
+
+static size_t
+format_record(struct log_record *rec, char *buffer, size_t size)
+{
+   if(!rec->fmt) return snprintf(buffer, size, "%s", rec->data);
+
+   size_t pos = 0;
+   int a = 0;
+   for(const char *c = rec->fmt; *c && pos < size - 1; ) {
+      if(*c != '%' || c[1] == '%') {
+         buffer[pos++] = *c;
+         c += (*c == '%') ? 2 : 1;
+         continue;
+      }
+
+      // copy one conversion spec and format its argument on its own
+      char spec[32];
+      size_t n = 0;
+      int nstar = 0, star[2] = { 0, 0 };
+      spec[n++] = *c++;
+      while(*c && n < sizeof spec - 2 && !strchr("diouxXbBcfFeEgGaAspnm", *c)) {
+         if(*c == '*' && nstar < 2 && a < rec->nargs) star[nstar++] = (int)rec->args[a++].i;
+         spec[n++] = *c++;
+      }
+      if(!*c) break;
+      spec[n++] = (*c == 'm') ? 's' : *c;
+      spec[n] = '\0';
+      c++;
+
+      if(a >= rec->nargs) break;
+      struct log_arg *arg = &rec->args[a++];
+      if(spec[n-1] == 'n') continue; // never write through a captured pointer
+      char *out = buffer + pos;
+      size_t len = size - pos;
+      int w = 0;
+      switch(arg->type) {
+         case ARG_INT:     w = FORMAT_ARG(int, arg->i); break;
+         case ARG_LONG:    w = FORMAT_ARG(long, arg->i); break;
+         case ARG_LLONG:   w = FORMAT_ARG(long long, arg->i); break;
+         case ARG_SIZE:    w = FORMAT_ARG(size_t, arg->i); break;
+         case ARG_INTMAX:  w = FORMAT_ARG(intmax_t, arg->i); break;
+         case ARG_PTRDIFF: w = FORMAT_ARG(ptrdiff_t, arg->i); break;
+         case ARG_DOUBLE:  w = FORMAT_ARG(double, arg->d); break;
+         case ARG_LDOUBLE: w = FORMAT_ARG(long double, arg->ld); break;
+         case ARG_STR:     w = FORMAT_ARG(const char*, rec->data + arg->str); break;
+         case ARG_PTR:     w = FORMAT_ARG(const void*, arg->p); break;
+      }
+      if(w > 0) pos += MIN((size_t)w, len - 1);
+   }
+   buffer[pos] = '\0';
+   return pos;
+}
+
+static void
+log_rotate()
+{
+   // <file> -> <file>.1 -> ... -> <file>.LOG_ROTATE_KEEP
+   const char *path = g_config->log_file;
+   char from[sizeof g_config->log_file + 8], to[sizeof g_config->log_file + 8];
+
+   fclose(log_state.out);
+   for(int i=LOG_ROTATE_KEEP; i>0; i--) {
+      if(i==1) snprintf(from, sizeof from, "%s", path);
+      else     snprintf(from, sizeof from, "%s.%d", path, i-1);
+      snprintf(to, sizeof to, "%s.%d", path, i);
+      rename(from, to);
+   }
+
+   if(!(log_state.out = fopen(path, "a"))) log_state.out = stderr;
+   log_state.written = 0;
+}
+
+static void
+log_write(int level, uint64_t ts, const char *text)
+{
+   int len = fprintf(log_state.out, "%02llu:%02llu:%02llu.%03llu [%s]: %s\n",
+         (unsigned long long)(ts / 3600000000000ull), (unsigned long long)(ts / 60000000000ull % 60),
+         (unsigned long long)(ts / 1000000000ull % 60), (unsigned long long)(ts / 1000000ull % 1000),
+         log_state.colour ? msg_str[level] : msg_plain[level], text);
+   if(len > 0) log_state.written += len;
+
+   if(log_state.max_size && log_state.out != stderr && log_state.written > log_state.max_size)
+      log_rotate();
+}
+
+static void*
+log_writer(void *data)
+{
+   char buffer[1024];
+
+   for(;;) {
+      sem_wait(&log_state.wake);
+
+      pthread_mutex_lock(&log_state.lock);
+      size_t tail = atomic_load_explicit(&log_state.tail, memory_order_relaxed);
+      while(tail != atomic_load_explicit(&log_state.head, memory_order_acquire)) {
+         struct log_record *rec = &log_state.ring[tail & (LOG_RING_SIZE - 1)];
+         format_record(rec, buffer, sizeof buffer);
+         log_write(rec->level, rec->ts, buffer);
+         atomic_store_explicit(&log_state.tail, ++tail, memory_order_release);
+      }
+
+      uint64_t dropped = atomic_load_explicit(&log_state.dropped, memory_order_relaxed);
+      if(dropped != log_state.dropped_reported) {
+         snprintf(buffer, sizeof buffer, "log ring full, %llu records dropped",
+               (unsigned long long)(dropped - log_state.dropped_reported));
+         log_write(WARNING, log_now() - log_state.start, buffer);
+         log_state.dropped_reported = dropped;
+      }
+      fflush(log_state.out);
+      pthread_mutex_unlock(&log_state.lock);
+
+      if(!atomic_load(&log_state.running)
+            && atomic_load(&log_state.tail) == atomic_load(&log_state.head))
+         break;
+   }
+   return NULL;
+}
+
+static bool
+log_write_direct(int level, const char *fmt, va_list args)
+{
+   // from threads other than the producer: bypass the ring, which has a single producer
+   uint64_t ts = log_now();
+   char buffer[1024];
+   vsnprintf(buffer, sizeof buffer, fmt, args);
+
+   pthread_mutex_lock(&log_state.lock);
+   bool running = atomic_load(&log_state.running);
+   if(running) {
+      log_write(level, ts - log_state.start, buffer);
+      fflush(log_state.out);
+   }
+   pthread_mutex_unlock(&log_state.lock);
+   return running;
+}
+
+static void
+log_wlr_callback(enum wlr_log_importance importance, const char *fmt, va_list args)
+{
+   // wlroots' own messages, preformatted because their format strings are not all literals
+   if(importance > wlr_log_get_verbosity()) return;
+   int level = importance==WLR_DEBUG ? DEBUG : importance==WLR_ERROR ? ERROR : INFO;
+   bool pushed;
+   va_list copy;
+   va_copy(copy, args);
+   if(pthread_equal(pthread_self(), log_state.producer))
+      pushed = atomic_load(&log_state.running) && log_push(level, fmt, copy, true);
+   else
+      pushed = log_write_direct(level, fmt, copy);
+   if(!pushed) {
+      vfprintf(stderr, fmt, args);
+      fputc('\n', stderr);
+   }
+   va_end(copy);
+}
+
+//------------------------------------------------------------------------
+void
+log_vsay(int level, const char *fmt, va_list args)
+{
+   if(atomic_load_explicit(&log_state.running, memory_order_relaxed)
+         && pthread_equal(pthread_self(), log_state.producer)) {
+      log_push(level, fmt, args, false);
+      return;
+   }
+   if(!pthread_equal(pthread_self(), log_state.producer)) {
+      va_list copy;
+      va_copy(copy, args);
+      bool written = log_write_direct(level, fmt, copy);
+      va_end(copy);
+      if(written) return;
+   }
+
+   // before log_init() and after log_finish()
+   char buffer[256];
+   vsnprintf(buffer, sizeof buffer, fmt, args);
+   wlr_log(level==DEBUG?WLR_DEBUG:WLR_INFO, CRESET"[%s]: %s", msg_str[level], buffer);
+}
+
+void
+log_init(int verbosity)
+{
+   log_state.out = stderr;
+   if(g_config->log_file[0]) {
+      FILE *f = fopen(g_config->log_file, "a");
+      if(f) {
+         struct stat st;
+         log_state.out = f;
+         log_state.written = fstat(fileno(f), &st) ? 0 : st.st_size;
+         log_state.max_size = (size_t)g_config->log_file_max_size * 1024;
+      } else {
+         say(WARNING, "Unable to open log file %s, logging to stderr", g_config->log_file);
+      }
+   }
+   log_state.colour = log_state.out == stderr && isatty(STDERR_FILENO);
+   log_state.start = log_now();
+   log_state.producer = pthread_self();
+   sem_init(&log_state.wake, 0, 0);
+
+   // the writer must not take signals meant for the compositor
+   sigset_t all, old;
+   sigfillset(&all);
+   pthread_sigmask(SIG_SETMASK, &all, &old);
+   atomic_store(&log_state.running, true);
+   if(pthread_create(&log_state.writer, NULL, log_writer, NULL)) {
+      atomic_store(&log_state.running, false);
+      say(WARNING, "Unable to start the log writer, logging synchronously");
+   }
+   pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+   if(atomic_load(&log_state.running)) {
+      wlr_log_init(verbosity, log_wlr_callback);
+      atexit(log_finish);
+   }
+}
+
+void
+log_finish()
+{
+   // drain the ring; called on exit and before say(ERROR) terminates
+   if(!pthread_equal(pthread_self(), log_state.producer)) return;
+   if(!atomic_exchange(&log_state.running, false)) return;
+
+   sem_post(&log_state.wake);
+   pthread_join(log_state.writer, NULL);
+   wlr_log_init(wlr_log_get_verbosity(), NULL);
+
+   // other threads check running under the lock before they write
+   pthread_mutex_lock(&log_state.lock);
+   if(log_state.out != stderr) fclose(log_state.out);
+   log_state.out = stderr;
+   pthread_mutex_unlock(&log_state.lock);
+}
+
+void
+log_report(FILE *f)
+{
+   size_t head = atomic_load(&log_state.head), tail = atomic_load(&log_state.tail);
+   fprintf(f, "running: %s\n", atomic_load(&log_state.running) ? "yes" : "no");
+   fprintf(f, "queued: %zu / %d\n", head - tail, LOG_RING_SIZE);
+   fprintf(f, "records: %zu\n", head);
+   fprintf(f, "dropped: %llu\n", (unsigned long long)atomic_load(&log_state.dropped));
+   fprintf(f, "output: %s\n", log_state.out != stderr ? g_config->log_file : "stderr");
+}
@@ -5,72 +5,50 @@
 
 #include <getopt.h>
 #include <signal.h>
-#include <sys/wait.h>
 #include <wlr/util/log.h>
 
 #include "globals.h"
 #include "server.h"
+#include "log.h"
+#include "pool.h"
 
-#define CRED      "\033[31m"
-#define CGREEN    "\033[32m"
-#define CYELLOW   "\033[33m"
-#define CBLUE     "\033[34m"
-#define CPURPLE   "\033[35m"
-#define CRESET    "\033[0m"
-
-static const char *msg_str[NMSG] = { CBLUE"DEBUG"CRESET, "INFO", CYELLOW"WARNING"CRESET, CRED"ERROR"CRESET };
 static int info_level = WLR_SILENT;
+int g_say_level = NMSG;    // lowest MessageType that is printed
 
 struct wlr_session *g_session;
 struct simple_server* g_server;
 struct simple_config* g_config;
 
-//------------------------------------------------------------------------
-void
-say(int level, const char* message, ...)
-{
-   char buffer[256];
-   va_list args;
-   va_start(args, message);
-   vsnprintf(buffer, 256, message, args);
-   va_end(args);
-
-   wlr_log(level==DEBUG?WLR_DEBUG:WLR_INFO, CRESET"[%s]: %s", msg_str[level], buffer);
-
-   if(level==ERROR) exit(EXIT_FAILURE);
-}
+#ifdef HAVE_USDT
+PROBE_LIST(PROBE_SEMAPHORE_DEFINE)
+#endif
 
+//------------------------------------------------------------------------
 void
-spawn(char* cmd)
+say_log(int level, const char* message, ...)
 {
-   say(DEBUG, "Spawn %s", cmd);
-
-   char *sh = NULL;
-   if(!(sh=getenv("SHELL"))) sh = (char*)"/bin/sh";
+   // called through the say() macro, which has already checked the level
+   if(level >= g_say_level) {
+      // formatting and output happen on the log writer thread (log.c)
+      va_list args;
+      va_start(args, message);
+      log_vsay(level, message, args);
+      va_end(args);
+   }
 
-   // from dwl:
-   pid_t pid = fork();
-   if(pid==0) {
-      dup2(STDERR_FILENO, STDOUT_FILENO);
-      setsid();
-      execl(sh, sh, "-c", cmd, (char*)NULL);
+   if(level==ERROR) {
+      flight_record(FL_ERROR, 0, 0, 0, NULL);
+      flight_dump(0);
+      log_finish();
+      exit(EXIT_FAILURE);
    }
 }
 
 void
 signal_handler(int sig)
 {
-   if(sig == SIGCHLD) {
-#if XWAYLAND
-      siginfo_t in;
-      while ( !waitid(P_ALL, 0, &in, WEXITED|WNOHANG|WNOWAIT)
-              && in.si_pid
-              && (!g_server->xwayland || in.si_pid != g_server->xwayland->server->pid) )
-         waitpid(in.si_pid, NULL, 0);
-#else
-      while (0 < waitpid(-1, NULL, WNOHANG));
-#endif
-   } else if (sig == SIGINT || sig == SIGTERM)
+   // SIGCHLD is handled on the event loop, see spawn.c
+   if (sig == SIGINT || sig == SIGTERM)
       wl_display_terminate(g_server->display);
 }
 
@@ -118,9 +96,14 @@ main(int argc, char **argv)
             exit(EXIT_SUCCESS);
          case 'd' :
             info_level = WLR_DEBUG;
+            g_say_level = DEBUG;
+#ifdef SAY_NO_DEBUG
+            printf("simplewc was built with -Ddebug_log=disabled, DEBUG messages are not available\n");
+#endif
             break;
          case 'i' :
             info_level = WLR_INFO;
+            g_say_level = INFO;
             break;
          case 'v' :
             printf("simplewc v"VERSION"\n");
@@ -139,7 +122,7 @@ main(int argc, char **argv)
       say(ERROR, "XDG_RUNTIME_DIR must be set!");
 
    // Handle signals
-   int signals[] = { SIGCHLD, SIGINT, SIGTERM, SIGPIPE };
+   int signals[] = { SIGINT, SIGTERM, SIGPIPE };
    struct sigaction sa;
    sa.sa_flags = 0;
    sa.sa_handler = signal_handler;
@@ -148,6 +131,9 @@ main(int argc, char **argv)
    for(int i=0; i<LENGTH(signals); i++)
       sigaction(signals[i], &sa, NULL);
 
+   // dump the flight recorder on crashes
+   flight_init();
+
    // Start WLR logging
    wlr_log_init(info_level, NULL);
 
@@ -163,6 +149,7 @@ main(int argc, char **argv)
    if(!(g_config = calloc(1, sizeof(struct simple_config))))
       say(ERROR, "Cannot allocate g_config");
    readConfiguration(config_file);
+   log_init(info_level);
 
    // Create a server
    if(!(g_server = calloc(1, sizeof(struct simple_server))))
@@ -179,6 +166,9 @@ main(int argc, char **argv)
    wl_display_run(g_server->display);
 
    cleanupServer();
+   freeConfiguration();
+   pool_finish();
+   log_finish();
 
    return EXIT_SUCCESS;
 }
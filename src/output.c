@@ -1,11 +1,15 @@
+#include <fnmatch.h>
 #include <string.h>
+#include <wlr/backend.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_output_swapchain_manager.h>
 #include <wlr/types/wlr_seat.h>
 
 #include <wlr/types/wlr_output_management_v1.h>
 #include <wlr/types/wlr_output_power_management_v1.h>
 #include <wlr/types/wlr_layer_shell_v1.h>
+#include <wlr/types/wlr_tearing_control_v1.h>
 
 #include "globals.h"
 #include "client.h"
@@ -14,41 +18,78 @@
 #include "input.h"
 #include "layer.h"
 #include "ipc.h"
+#include "wallpaper.h"
+#include "launch.h"
 
 //------------------------------------------------------------------------
-void
-arrange_outputs()
+const struct tagset*
+output_visible_tags(struct simple_output *output)
 {
-   say(DEBUG, "arrange_outputs");
-   struct simple_client* client, *focused_client=NULL;
-   struct simple_output* test_output;
+   // a fixed output keeps showing its fixed tag whatever is selected
+   return tagset_empty(&output->fixed_tag) ? &output->visible_tags : &output->fixed_tag;
+}
 
-   get_client_from_surface(g_server->seat->keyboard_state.focused_surface, &focused_client, NULL);
-   
-   // reset fullscreen_bg for each outputs
-   wl_list_for_each(test_output, &g_server->outputs, link)
-      wlr_scene_node_set_enabled(&test_output->fullscreen_bg->node, 0);
+static void
+arrange_output_clients(struct simple_output *output, struct simple_client *focused_client)
+{
+   struct simple_client* client;
 
-   int n=0;
-   bool is_client_visible=false;
-   wl_list_for_each(client, &g_server->clients, link) {
-      if(client->destroy_requested) continue;
+   // reset fullscreen_bg
+   wlr_scene_node_set_enabled(&output->fullscreen_bg->node, 0);
 
-      if(client->output->fixed_tag<0)
-         is_client_visible = (client->visible && (client->fixed || (client->tag & g_server->visible_tags)));
-      else
-         is_client_visible = (client->visible && (client->fixed || (client->tag & client->output->fixed_tag)));
+   wl_list_for_each(client, &g_server->clients, link) {
+      if(client->destroy_requested || client->output != output) continue;
 
-      if(is_client_visible) n++;
       set_client_border_colour(client, client==focused_client ? FOCUSED : UNFOCUSED);
-      wlr_scene_node_set_enabled(&client->scene_tree->node, is_client_visible);
+      wlr_scene_node_set_enabled(&client->scene_tree->node, client->visible && is_client_tag_visible(client));
    }
+}
 
-   focused_client = get_top_client_from_output(g_server->cur_output, false);
+static void
+arrange_focus()
+{
+   struct simple_client* focused_client = get_top_client_from_output(g_server->cur_output, false);
    if(focused_client)
       focus_client(focused_client, true);
    else
       input_focus_surface(NULL);
+}
+
+void
+arrange_output(struct simple_output *output)
+{
+   // only the clients of this output change visibility (e.g. after a tag switch)
+   say(DEBUG, "arrange_output");
+   TRACE_SCOPE("arrange_output");
+   struct simple_client* focused_client=NULL;
+
+   get_client_from_surface(g_server->seat->keyboard_state.focused_surface, &focused_client, NULL);
+   arrange_output_clients(output, focused_client);
+
+   if(output == g_server->cur_output || (focused_client && focused_client->output == output))
+      arrange_focus();
+
+   output_update_adaptive_sync(output);
+   check_idle_inhibitor();
+}
+
+void
+arrange_outputs()
+{
+   say(DEBUG, "arrange_outputs");
+   TRACE_SCOPE("arrange_outputs");
+   struct simple_client* focused_client=NULL;
+   struct simple_output* test_output;
+
+   get_client_from_surface(g_server->seat->keyboard_state.focused_surface, &focused_client, NULL);
+
+   wl_list_for_each(test_output, &g_server->outputs, link)
+      arrange_output_clients(test_output, focused_client);
+
+   arrange_focus();
+
+   wl_list_for_each(test_output, &g_server->outputs, link)
+      output_update_adaptive_sync(test_output);
 
    check_idle_inhibitor();
 }
@@ -73,8 +114,8 @@ void
 toggleFixedTag(){
    struct simple_output* output = g_server->cur_output;
 
-   if(output->fixed_tag<0) {
-      output->fixed_tag = g_server->current_tag;
+   if(tagset_empty(&output->fixed_tag)) {
+      tagset_copy(&output->fixed_tag, &output->current_tag);
 
       // draw the border
       int bw = g_config->border_width;
@@ -86,26 +127,242 @@ toggleFixedTag(){
       wlr_scene_node_set_position(&outline->tree->node, output->usable_area.x+bw, output->usable_area.y+bw);
       //---
    } else {
-      output->fixed_tag = -1;
+      tagset_clear(&output->fixed_tag);
 
       wlr_scene_node_destroy(&output->outline->tree->node);
    }
 }
 
+void
+output_set_power(struct simple_output *output, enum OutputPowerState state)
+{
+   if(output->power_state == state) return;
+   output->power_state = state;
+
+   // clients held back while the output was off get one frame to catch up
+   if(state == POWER_ON)
+      wlr_output_schedule_frame(output->wlr_output);
+}
+
+void
+output_resume_frames()
+{
+   struct simple_output *output;
+   wl_list_for_each(output, &g_server->outputs, link) {
+      if(output->power_state == POWER_ON && output->wlr_output->enabled)
+         wlr_output_schedule_frame(output->wlr_output);
+   }
+}
+
+//--- Adaptive sync ------------------------------------------------------
+static bool
+output_has_fullscreen_client(struct simple_output *output)
+{
+   struct simple_client *client;
+   wl_list_for_each(client, &g_server->clients, link) {
+      if(client->output != output || !client->fullscreen || client->destroy_requested) continue;
+      if(client->visible && client->scene_tree && client->scene_tree->node.enabled)
+         return true;
+   }
+   return false;
+}
+
+void
+output_update_adaptive_sync(struct simple_output *output)
+{
+   if(!output || !output->wlr_output->enabled) return;
+
+   bool want = output->adaptive_sync == VRR_ON ||
+      (output->adaptive_sync == VRR_FULLSCREEN && output_has_fullscreen_client(output));
+   bool enabled = output->wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+   if(want == enabled) return;
+
+   if(want && !output->wlr_output->adaptive_sync_supported) {
+      say(DEBUG, "Output %s does not support adaptive sync", output->wlr_output->name);
+      return;
+   }
+
+   struct wlr_output_state state;
+   wlr_output_state_init(&state);
+   wlr_output_state_set_adaptive_sync_enabled(&state, want);
+   if(!wlr_output_commit_state(output->wlr_output, &state))
+      say(WARNING, "Unable to %s adaptive sync on output %s", want?"enable":"disable", output->wlr_output->name);
+   wlr_output_state_finish(&state);
+
+   say(DEBUG, "adaptive sync on %s: %s", output->wlr_output->name, want?"enabled":"disabled");
+}
+
+void
+setOutputAdaptiveSync(const char *arg)
+{
+   // arg = "on|off|fullscreen [output name]"
+   char mode[16] = {0}, name[32] = {0};
+   if(sscanf(arg, "%15s %31s", mode, name) < 1) return;
+
+   struct simple_output *output;
+   wl_list_for_each(output, &g_server->outputs, link) {
+      if(name[0]!='\0' && strcmp(name, output->wlr_output->name)) continue;
+      output->adaptive_sync = parse_adaptive_sync(mode);
+      output_update_adaptive_sync(output);
+   }
+}
+
+static int
+get_adaptive_sync_rule(struct wlr_output *wlr_output)
+{
+   struct output_rule *rule;
+   wl_list_for_each(rule, &g_config->output_rules, link) {
+      if(!strcmp(rule->name, wlr_output->name))
+         return rule->adaptive_sync;
+   }
+   return g_config->adaptive_sync;
+}
+
+//--- Tearing control -----------------------------------------------------
+bool
+tearing_allowed_for(const char *app_id, bool fullscreen, bool async_hint)
+{
+   // policy only: fullscreen, client asked for async presentation, and app_id is allowlisted
+   if(!fullscreen || !async_hint || !app_id) return false;
+
+   struct tearing_rule *rule;
+   wl_list_for_each(rule, &g_config->tearing_rules, link) {
+      if(!strcmp(rule->app_id, app_id) || !strcmp(rule->app_id, "*"))
+         return true;
+   }
+   return false;
+}
+
+bool
+output_allow_tearing(struct simple_output *output)
+{
+   if(wl_list_empty(&g_config->tearing_rules) || g_server->locked) return false;
+
+   struct wlr_surface *surface = g_server->seat->keyboard_state.focused_surface;
+   struct simple_client *client = NULL;
+   if(get_client_from_surface(surface, &client, NULL) < 0 || !client || client->output != output)
+      return false;
+
+   enum wp_tearing_control_v1_presentation_hint hint = 
+      wlr_tearing_control_manager_v1_surface_hint_from_surface(g_server->tearing_control_manager, 
+            wlr_surface_get_root_surface(surface));
+
+   return tearing_allowed_for(get_client_appid(client), client->fullscreen,
+         hint == WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC);
+}
+
+//--- Frame statistics ---------------------------------------------------
+static void
+frame_stats_update(struct frame_stats *stats, struct timespec *now)
+{
+   if(stats->frames++ > 0) {
+      int64_t interval = (int64_t)(now->tv_sec - stats->last.tv_sec) * 1000000000 
+         + (now->tv_nsec - stats->last.tv_nsec);
+      stats->interval_last = interval;
+      if(stats->interval_min==0 || interval < stats->interval_min) stats->interval_min = interval;
+      if(interval > stats->interval_max) stats->interval_max = interval;
+      // exponential moving average over ~16 frames
+      stats->interval_avg = stats->interval_avg ? stats->interval_avg + (interval - stats->interval_avg)/16 : interval;
+   }
+   stats->last = *now;
+}
+
+void
+output_report_frames(FILE *f)
+{
+   struct simple_output *output;
+   wl_list_for_each(output, &g_server->outputs, link) {
+      struct wlr_output *wlr_output = output->wlr_output;
+      struct frame_stats *stats = &output->stats;
+      const char *policy[] = { "off", "on", "fullscreen" };
+
+      fprintf(f, "output %s: %dx%d@%.3fHz power=%s\n", wlr_output->name,
+            wlr_output->width, wlr_output->height, wlr_output->refresh/1000.0,
+            output->power_state==POWER_ON ? "on" : "off");
+      fprintf(f, "  adaptive_sync: policy=%s supported=%s enabled=%s\n", policy[output->adaptive_sync],
+            wlr_output->adaptive_sync_supported ? "yes" : "no",
+            wlr_output->adaptive_sync_status==WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED ? "yes" : "no");
+      fprintf(f, "  nominal refresh interval: %.3f ms\n", 
+            wlr_output->refresh ? 1000000.0/wlr_output->refresh : 0.0);
+      fprintf(f, "  frames=%lu interval (ms): last=%.3f avg=%.3f min=%.3f max=%.3f\n",
+            (unsigned long)stats->frames, stats->interval_last/1e6, stats->interval_avg/1e6,
+            stats->interval_min/1e6, stats->interval_max/1e6);
+   }
+}
+
+//--- Frame callbacks ----------------------------------------------------
+struct frame_done_data {
+   struct wlr_scene_output *scene_output;
+   struct timespec *when;
+};
+
+static bool
+is_lock_surface_buffer(struct wlr_scene_buffer *buffer)
+{
+   for(struct wlr_scene_tree *tree = buffer->node.parent; tree; tree = tree->node.parent)
+      if(tree == g_server->layer_tree[LyrLock]) return true;
+   return false;
+}
+
+static void
+send_frame_done_iterator(struct wlr_scene_buffer *buffer, int sx, int sy, void *data)
+{
+   struct frame_done_data *fd = data;
+   struct wlr_scene_output *primary = buffer->primary_output;
+
+   // while locked, only the lock surfaces are allowed to draw
+   if(g_server->locked && !is_lock_surface_buffer(buffer))
+      return;
+
+   // surfaces spanning several outputs are paced by their primary output, 
+   // unless that output is powered off
+   if(primary && primary != fd->scene_output) {
+      struct simple_output *primary_output = primary->output->data;
+      if(!primary_output || primary_output->power_state == POWER_ON)
+         return;
+   }
+
+   wlr_scene_buffer_send_frame_done(buffer, fd->when);
+}
+
 //--- Output notify functions --------------------------------------------
 static void 
 output_frame_notify(struct wl_listener *listener, void *data) 
 {
    //say(DEBUG, "output_frame_notify");
+   TRACE_SCOPE("output_frame");
+   WATCHDOG_SCOPE("output_frame");
    struct simple_output *output = wl_container_of(listener, output, frame);
+   PROBE(frame_start, output->wlr_output->name);
    struct wlr_scene_output *scene_output = wlr_scene_get_scene_output(g_server->scene, output->wlr_output);
    
    // Render the scene if needed and commit the output 
-   wlr_scene_output_commit(scene_output, NULL);
-   
+   if(output_allow_tearing(output)) {
+      if(wlr_scene_output_needs_frame(scene_output)) {
+         struct wlr_output_state state;
+         wlr_output_state_init(&state);
+         if(wlr_scene_output_build_state(scene_output, &state, NULL)) {
+            // fall back to a regular page-flip if the backend refuses
+            state.tearing_page_flip = true;
+            if(!wlr_output_test_state(output->wlr_output, &state))
+               state.tearing_page_flip = false;
+            wlr_output_commit_state(output->wlr_output, &state);
+         }
+         wlr_output_state_finish(&state);
+      }
+   } else
+      wlr_scene_output_commit(scene_output, NULL);
+
+   // Surfaces only visible on a powered-off output never get here, so they stop drawing 
+   // while keeping their buffers
    struct timespec now;
    clock_gettime(CLOCK_MONOTONIC, &now);
-   wlr_scene_output_send_frame_done(scene_output, &now);
+   frame_stats_update(&output->stats, &now);
+   launch_output_frame(output);
+
+   struct frame_done_data fd = { .scene_output = scene_output, .when = &now };
+   wlr_scene_output_for_each_buffer(scene_output, send_frame_done_iterator, &fd);
+   PROBE(frame_end, output->wlr_output->name, output->stats.frames);
 }
 
 static void 
@@ -123,6 +380,7 @@ output_destroy_notify(struct wl_listener *listener, void *data)
 {
    say(DEBUG, "output_destroy_notify");
    struct simple_output *output = wl_container_of(listener, output, destroy);
+   flight_record(FL_OUTPUT_REMOVE, 0, 0, 0, output->wlr_output->name);
 
    struct simple_ipc_output *ipc_output, *ipc_output_tmp;
    wl_list_for_each_safe(ipc_output, ipc_output_tmp, &output->ipc_outputs, link)
@@ -136,6 +394,9 @@ output_destroy_notify(struct wl_listener *listener, void *data)
          wlr_layer_surface_v1_destroy(l->scene_layer_surface->layer_surface);
    }
 
+   if(output->arrange_layers_idle)
+      wl_event_source_remove(output->arrange_layers_idle);
+
    wl_list_remove(&output->frame.link);
    wl_list_remove(&output->request_state.link);
    wl_list_remove(&output->destroy.link);
@@ -144,13 +405,15 @@ output_destroy_notify(struct wl_listener *listener, void *data)
    wlr_output_layout_remove(g_server->output_layout, output->wlr_output);
    //wlr_scene_output_destroy(output->scene_output);
 
+   // cur_output must not dangle, even when no other output is left
+   if(g_server->cur_output == output) g_server->cur_output = NULL;
    struct simple_output *test_output;
    wl_list_for_each(test_output, &g_server->outputs, link) {
       if(test_output == output) continue;
       if(test_output->wlr_output->enabled) g_server->cur_output = test_output;
    }
 
-   // Move clients to the previous output
+   // Move clients to the previous output, or to none if it was the last one
    struct simple_client * client;
    wl_list_for_each(client, &g_server->clients, link) {
       if(client->output != output) continue;
@@ -160,24 +423,327 @@ output_destroy_notify(struct wl_listener *listener, void *data)
          set_client_geometry(client, false);
       }
       struct simple_output *new_op = get_output_at(client->geom.x, client->geom.y);
-      if(new_op->wlr_output->enabled && new_op==g_server->cur_output) 
-         client->output = new_op;
-   
-      //client->output = g_server->cur_output;
+      if(!new_op || !new_op->wlr_output->enabled) new_op = g_server->cur_output;
+
+      // tags are per output: show the client on the tag it lands on
+      client->output = new_op;
+      if(new_op) tagset_copy(&client->tag, &new_op->current_tag);
    }
 
    wlr_scene_node_destroy(&output->fullscreen_bg->node);
+   wallpaper_output_destroy(output);
+   tagset_finish(&output->fixed_tag);
+   tagset_finish(&output->current_tag);
+   tagset_finish(&output->visible_tags);
    free(output);
 
-   print_server_info();
+   // the remaining outputs may match another profile (e.g. undocking)
+   schedule_output_configure();
+   schedule_output_relayout();
 }
 
-//------------------------------------------------------------------------
-void 
-output_layout_change_notify(struct wl_listener *listener, void *data) 
+//--- Output configuration -----------------------------------------------
+static void
+update_background_geometry()
 {
-   // Called when the output layout changes: e.g. adding/removing a monitor
-   say(DEBUG, "output_layout_change_notify");
+   struct wlr_box geom;
+   wlr_output_layout_get_box(g_server->output_layout, NULL, &geom);
+
+   wlr_scene_node_set_position(&g_server->root_bg->node, geom.x, geom.y);
+   wlr_scene_rect_set_size(g_server->root_bg, geom.width, geom.height);
+   wlr_scene_node_set_position(&g_server->locked_bg->node, geom.x, geom.y);
+   wlr_scene_rect_set_size(g_server->locked_bg, geom.width, geom.height);
+}
+
+static void
+output_layout_place(struct wlr_output *wlr_output, bool enabled, bool auto_position, int x, int y)
+{
+   struct wlr_output_layout_output *l_output = wlr_output_layout_get(g_server->output_layout, wlr_output);
+   bool in_layout = l_output != NULL;
+
+   if(!enabled) {
+      if(in_layout)
+         wlr_output_layout_remove(g_server->output_layout, wlr_output);
+      return;
+   }
+   if(in_layout && auto_position) return;
+
+   l_output = auto_position ? wlr_output_layout_add_auto(g_server->output_layout, wlr_output)
+                            : wlr_output_layout_add(g_server->output_layout, wlr_output, x, y);
+   if(in_layout) return;
+
+   // removing the output from the layout destroyed its scene output
+   struct wlr_scene_output *scene_output = wlr_scene_get_scene_output(g_server->scene, wlr_output);
+   if(!scene_output)
+      scene_output = wlr_scene_output_create(g_server->scene, wlr_output);
+   wlr_scene_output_layout_add_output(g_server->scene_output_layout, l_output, scene_output);
+}
+
+bool
+output_commit_states(struct wlr_backend_output_state *states, size_t n_states, bool test_only)
+{
+   // All outputs are tested/committed at once through the backend, so a multi-head
+   // reconfiguration is one modeset instead of one per output
+   struct wlr_output_swapchain_manager swapchain_manager;
+   wlr_output_swapchain_manager_init(&swapchain_manager, g_server->backend);
+
+   bool ok = wlr_output_swapchain_manager_prepare(&swapchain_manager, states, n_states);
+
+   for(size_t i=0; ok && i<n_states; i++) {
+      struct wlr_backend_output_state *os = &states[i];
+      bool enabled = (os->base.committed & WLR_OUTPUT_STATE_ENABLED) ? os->base.enabled : os->output->enabled;
+      if(!enabled) continue;
+
+      // render a frame with the new configuration into the new swapchain
+      struct wlr_scene_output *scene_output = wlr_scene_get_scene_output(g_server->scene, os->output);
+      if(!scene_output)
+         scene_output = wlr_scene_output_create(g_server->scene, os->output);
+
+      struct wlr_scene_output_state_options options = {
+         .swapchain = wlr_output_swapchain_manager_get_swapchain(&swapchain_manager, os->output),
+      };
+      ok = wlr_scene_output_build_state(scene_output, &os->base, &options);
+   }
+
+   if(ok)
+      ok = test_only ? wlr_backend_test(g_server->backend, states, n_states)
+                     : wlr_backend_commit(g_server->backend, states, n_states);
+
+   if(ok && !test_only)
+      wlr_output_swapchain_manager_apply(&swapchain_manager);
+
+   wlr_output_swapchain_manager_finish(&swapchain_manager);
+   return ok;
+}
+
+void
+output_manager_apply(struct wlr_output_configuration_v1 *config, bool test_only)
+{
+   size_t n_states = wl_list_length(&config->heads);
+   struct wlr_backend_output_state *states = calloc(n_states, sizeof(struct wlr_backend_output_state));
+   if(!states) {
+      wlr_output_configuration_v1_send_failed(config);
+      wlr_output_configuration_v1_destroy(config);
+      return;
+   }
+
+   size_t i=0;
+   struct wlr_output_configuration_head_v1 *head;
+   wl_list_for_each(head, &config->heads, link) {
+      struct wlr_backend_output_state *os = &states[i++];
+      os->output = head->state.output;
+      wlr_output_state_init(&os->base);
+      wlr_output_head_v1_state_apply(&head->state, &os->base);
+   }
+
+   bool ok = output_commit_states(states, n_states, test_only);
+   say(DEBUG, "output configuration %s %s", test_only ? "test" : "apply", ok ? "succeeded" : "failed");
+
+   if(ok && !test_only) {
+      wl_list_for_each(head, &config->heads, link) {
+         struct simple_output *output = head->state.output->data;
+         output_layout_place(head->state.output, head->state.enabled, false, head->state.x, head->state.y);
+         if(output)
+            output->power_state = head->state.enabled ? POWER_ON : POWER_OFF;
+      }
+
+      // layout might not have changed (e.g. mode only), so refresh areas and the advertised config
+      schedule_output_relayout();
+   }
+
+   if(ok) wlr_output_configuration_v1_send_succeeded(config);
+   else   wlr_output_configuration_v1_send_failed(config);
+   wlr_output_configuration_v1_destroy(config);
+
+   for(i=0; i<n_states; i++)
+      wlr_output_state_finish(&states[i].base);
+   free(states);
+}
+
+//--- Output profiles ----------------------------------------------------
+static bool
+output_matches(struct wlr_output *wlr_output, const char *match)
+{
+   if(!strcmp(match, wlr_output->name)) return true;
+
+   char id[192];
+   snprintf(id, sizeof id, "%s:%s:%s", wlr_output->make ? wlr_output->make : "",
+         wlr_output->model ? wlr_output->model : "", wlr_output->serial ? wlr_output->serial : "");
+   for(char *c=id; *c; c++)
+      if(*c==' ') *c='_';
+
+   return !fnmatch(match, id, 0);
+}
+
+static struct output_profile*
+find_output_profile()
+{
+   // a profile matches when each connected output matches exactly one of its entries
+   struct output_profile *profile;
+   struct output_profile_entry *entry;
+   struct simple_output *output;
+   int n_outputs = wl_list_length(&g_server->outputs);
+
+   wl_list_for_each(profile, &g_config->output_profiles, link) {
+      if(wl_list_length(&profile->entries) != n_outputs) continue;
+
+      wl_list_for_each(entry, &profile->entries, link)
+         entry->used = false;
+
+      bool matched = true;
+      wl_list_for_each(output, &g_server->outputs, link) {
+         output->profile_entry = NULL;
+         wl_list_for_each(entry, &profile->entries, link) {
+            if(entry->used || !output_matches(output->wlr_output, entry->match)) continue;
+            entry->used = true;
+            output->profile_entry = entry;
+            break;
+         }
+         if(!output->profile_entry) {
+            matched = false;
+            break;
+         }
+      }
+      if(matched) return profile;
+   }
+
+   wl_list_for_each(output, &g_server->outputs, link)
+      output->profile_entry = NULL;
+   return NULL;
+}
+
+static void
+output_build_state(struct simple_output *output, struct wlr_output_state *state)
+{
+   struct wlr_output *wlr_output = output->wlr_output;
+   struct output_profile_entry *entry = output->profile_entry;
+
+   // The output may be disabled. Switch it on unless the profile says otherwise
+   wlr_output_state_set_enabled(state, !entry || entry->enabled);
+   if(entry && !entry->enabled) return;
+
+   struct wlr_output_mode *mode = NULL, *test_mode;
+   if(entry && entry->width>0 && entry->height>0) {
+      wl_list_for_each(test_mode, &wlr_output->modes, link) {
+         if(test_mode->width!=entry->width || test_mode->height!=entry->height) continue;
+         if(entry->refresh>0 && abs(test_mode->refresh - entry->refresh) > 500) continue;
+         if(!mode || test_mode->refresh > mode->refresh) mode = test_mode;
+      }
+      if(!mode)
+         wlr_output_state_set_custom_mode(state, entry->width, entry->height, entry->refresh);
+   } else 
+      mode = wlr_output_preferred_mode(wlr_output);
+
+   if(mode)
+      wlr_output_state_set_mode(state, mode);
+
+   if(entry && entry->scale > 0)          wlr_output_state_set_scale(state, entry->scale);
+   if(entry && entry->transform >= 0)     wlr_output_state_set_transform(state, entry->transform);
+   if(entry && entry->adaptive_sync >= 0) output->adaptive_sync = entry->adaptive_sync;
+
+   // adaptive sync is only requested up front when it is always on
+   if(wlr_output->adaptive_sync_supported)
+      wlr_output_state_set_adaptive_sync_enabled(state, output->adaptive_sync == VRR_ON);
+}
+
+static void
+configure_outputs()
+{
+   struct simple_output *output;
+   size_t n_states = wl_list_length(&g_server->outputs), i = 0;
+   if(n_states == 0) return;
+
+   struct output_profile *profile = find_output_profile();
+
+   bool any_enabled = false;
+   wl_list_for_each(output, &g_server->outputs, link)
+      if(output->configured && output->wlr_output->enabled) any_enabled = true;
+
+   struct wlr_backend_output_state *states = calloc(n_states, sizeof(struct wlr_backend_output_state));
+   if(!states) return;
+
+   // With a matching profile every output is (re)configured, otherwise only the new ones
+   // (or all of them if nothing would be lit, e.g. after undocking)
+   wl_list_for_each(output, &g_server->outputs, link) {
+      if(!profile && output->configured && any_enabled) continue;
+
+      struct wlr_backend_output_state *os = &states[i++];
+      os->output = output->wlr_output;
+      wlr_output_state_init(&os->base);
+      output_build_state(output, &os->base);
+   }
+   n_states = i;
+
+   if(profile)
+      say(INFO, "Applying output profile %s", profile->name);
+
+   if(n_states > 0 && !output_commit_states(states, n_states, false)) {
+      say(WARNING, "Unable to apply output configuration, falling back to defaults");
+      for(i=0; i<n_states; i++) {
+         struct simple_output *op = states[i].output->data;
+         op->profile_entry = NULL;
+         wlr_output_state_finish(&states[i].base);
+         wlr_output_state_init(&states[i].base);
+         output_build_state(op, &states[i].base);
+         if(!wlr_output_test_state(states[i].output, &states[i].base))
+            wlr_output_state_set_adaptive_sync_enabled(&states[i].base, false);
+         wlr_output_commit_state(states[i].output, &states[i].base);
+      }
+   }
+
+   for(i=0; i<n_states; i++) {
+      struct simple_output *op = states[i].output->data;
+      struct output_profile_entry *entry = op->profile_entry;
+      wlr_output_state_finish(&states[i].base);
+
+      op->configured = true;
+      op->power_state = op->wlr_output->enabled ? POWER_ON : POWER_OFF;
+      output_layout_place(op->wlr_output, op->wlr_output->enabled, 
+            !(entry && entry->has_position), entry ? entry->x : 0, entry ? entry->y : 0);
+      if(!op->wlr_output->enabled) continue;
+
+      struct wlr_box box;
+      wlr_output_layout_get_box(g_server->output_layout, op->wlr_output, &box);
+      say(INFO, " -> Output %s : %dx%d+%d+%d", op->wlr_output->name, box.width, box.height, box.x, box.y);
+   }
+   free(states);
+
+   wlr_scene_node_set_enabled(&g_server->root_bg->node, 1);
+
+   if(!g_server->cur_output || !g_server->cur_output->wlr_output->enabled)
+      g_server->cur_output = get_output_at(g_server->cursor->x, g_server->cursor->y);
+
+   schedule_output_relayout();
+}
+
+void
+schedule_output_configure()
+{
+   // runs from the re-layout timer below, so a burst of hotplug events spread
+   // over several loop iterations still ends in a single modeset
+   g_server->output_configure_requested = true;
+   schedule_output_relayout();
+}
+
+void
+output_configure_pending()
+{
+   if(!g_server->output_configure_requested) return;
+
+   g_server->output_configure_requested = false;
+   configure_outputs();
+}
+
+//--- Output re-layout ---------------------------------------------------
+// Hotplug produces bursts of new-output, destroy and layout-change events (a dock with
+// three displays fires a dozen). They only arm a short timer; once the topology has
+// settled, output profiles are applied and layers, usable areas and clients re-laid out.
+#define OUTPUT_RELAYOUT_DELAY 50 // ms
+
+static void
+output_relayout()
+{
+   say(DEBUG, "output_relayout");
 
    struct wlr_output_configuration_v1 *config = wlr_output_configuration_v1_create();
    struct wlr_output_configuration_head_v1 *config_head;
@@ -187,25 +753,33 @@ output_layout_change_notify(struct wl_listener *listener, void *data)
    struct simple_output *output;
 
    wl_list_for_each(output, &g_server->outputs, link) {
-      if(!output->wlr_output->enabled) continue;
-
+      // disabled outputs are advertised too, so that they can be re-enabled
       config_head = wlr_output_configuration_head_v1_create(config, output->wlr_output);
       if(!config_head) {
          wlr_output_configuration_v1_destroy(config);
          say(ERROR, "wlr_output_configuration_head_v1_create failed");
       }
 
+      if(!output->wlr_output->enabled) continue;
+
       struct wlr_box box;
       wlr_output_layout_get_box(g_server->output_layout, output->wlr_output, &box);
-      if(wlr_box_empty(&box))
-         say(ERROR, "Failed to get output layout box");
+      if(wlr_box_empty(&box)) {
+         // enabled but not placed yet (e.g. in the middle of an output configuration)
+         say(DEBUG, "Output %s is not in the layout yet", output->wlr_output->name);
+         continue;
+      }
 
       memset(&output->usable_area, 0, sizeof(output->usable_area));
       memset(&output->full_area, 0, sizeof(output->full_area));
       output->usable_area = output->full_area = box;
+      flight_record(FL_OUTPUT_LAYOUT, 0, box.width<<16 | (box.height & 0xffff),
+            (uint32_t)box.x<<16 | (box.y & 0xffff), output->wlr_output->name);
 
       arrange_layers(output);
-      arrange_outputs();
+
+      wlr_scene_node_set_position(&output->fullscreen_bg->node, output->full_area.x, output->full_area.y);
+      wlr_scene_rect_set_size(output->fullscreen_bg, output->full_area.width, output->full_area.height);
 
       config_head->state.x = box.x;
       config_head->state.y = box.y;
@@ -215,6 +789,57 @@ output_layout_change_notify(struct wl_listener *listener, void *data)
       wlr_output_manager_v1_set_configuration(g_server->output_manager, config);
    else
       say(ERROR, "wlr_output_manager_v1_set_configuration failed");
+
+   // update background and lock geometry
+   update_background_geometry();
+   wallpaper_update_outputs();
+
+   arrange_outputs();
+   print_server_info();
+}
+
+static int
+output_relayout_timer_notify(void *data)
+{
+   WATCHDOG_SCOPE("output_relayout");
+   output_configure_pending();
+
+   // the modeset has re-armed the timer, its layout changes are handled here
+   wl_event_source_timer_update(g_server->output_relayout_timer, 0);
+   g_server->output_relayout_pending = false;
+   output_relayout();
+   return 0;
+}
+
+void
+schedule_output_relayout()
+{
+   if(!g_server->output_relayout_timer)
+      g_server->output_relayout_timer = 
+         wl_event_loop_add_timer(g_server->event_loop, output_relayout_timer_notify, NULL);
+
+   // every new event pushes the deadline back
+   g_server->output_relayout_pending = true;
+   wl_event_source_timer_update(g_server->output_relayout_timer, OUTPUT_RELAYOUT_DELAY);
+}
+
+void
+output_relayout_flush()
+{
+   if(!g_server->output_relayout_pending) return;
+
+   wl_event_source_timer_update(g_server->output_relayout_timer, 0);
+   g_server->output_relayout_pending = false;
+   output_relayout();
+}
+
+//------------------------------------------------------------------------
+void 
+output_layout_change_notify(struct wl_listener *listener, void *data) 
+{
+   // Called when the output layout changes: e.g. adding/removing a monitor
+   say(DEBUG, "output_layout_change_notify");
+   schedule_output_relayout();
 }
 
 void 
@@ -233,25 +858,17 @@ new_output_notify(struct wl_listener *listener, void *data)
    // Must be done once, before committing the output
    if(!wlr_output_init_render(wlr_output, g_server->allocator, g_server->renderer))
       say(ERROR, "unable to initialize output renderer");
-   
-   // The output may be disabled. Switch it on
-   struct wlr_output_state state;
-   wlr_output_state_init(&state);
-   wlr_output_state_set_enabled(&state, true);
-
-   struct wlr_output_mode *mode = wlr_output_preferred_mode(wlr_output);
-   if (mode)
-      wlr_output_state_set_mode(&state, mode);
-
-   wlr_output_commit_state(wlr_output, &state);
-   wlr_output_state_finish(&state);
 
    struct simple_output *output = calloc(1, sizeof(struct simple_output));
    output->wlr_output = wlr_output;
+   flight_record(FL_OUTPUT_ADD, 0, 0, 0, wlr_output->name);
+   output->adaptive_sync = get_adaptive_sync_rule(wlr_output);
    wlr_output->data = output;
 
    // set default tag - do this before adding the current output to the global list
-   output->fixed_tag = -1;
+   tagset_single(&output->current_tag, 0);
+   tagset_single(&output->visible_tags, 0);
+   output->power_state = POWER_ON;
 
    wl_list_init(&output->ipc_outputs);   // ipc addition
 
@@ -264,6 +881,14 @@ new_output_notify(struct wl_listener *listener, void *data)
 
    wl_list_insert(&g_server->outputs, &output->link);
 
+   // adopt the clients left without an output when the last one went away
+   struct simple_client *client;
+   wl_list_for_each(client, &g_server->clients, link) {
+      if(client->output) continue;
+      client->output = output;
+      tagset_copy(&client->tag, &output->current_tag);
+   }
+
    for(int i=0; i<N_LAYER_SHELL_LAYERS; i++)
       wl_list_init(&output->layer_shells[i]);
    
@@ -274,31 +899,7 @@ new_output_notify(struct wl_listener *listener, void *data)
    wlr_scene_node_raise_to_top(&g_server->layer_tree[LyrOverlay]->node);
    wlr_scene_node_raise_to_top(&g_server->layer_tree[LyrLock]->node);
 
-
-   struct wlr_output_layout_output *l_output =
-      wlr_output_layout_add_auto(g_server->output_layout, wlr_output);
-   struct wlr_scene_output *scene_output =
-      wlr_scene_output_create(g_server->scene, wlr_output);
-   wlr_scene_output_layout_add_output(g_server->scene_output_layout, l_output, scene_output);
-
-   // update background and lock geometry
-   struct wlr_box geom;
-   wlr_output_layout_get_box(g_server->output_layout, NULL, &geom);
-
-   wlr_scene_node_set_position(&g_server->root_bg->node, geom.x, geom.y);
-   wlr_scene_rect_set_size(g_server->root_bg, geom.width, geom.height);
-   wlr_scene_node_set_position(&g_server->locked_bg->node, geom.x, geom.y);
-   wlr_scene_rect_set_size(g_server->locked_bg, geom.width, geom.height);
-
-   wlr_scene_node_set_position(&output->fullscreen_bg->node, output->usable_area.x, output->usable_area.y);
-   wlr_scene_rect_set_size(output->fullscreen_bg, output->usable_area.width, output->usable_area.height);
-
-   wlr_scene_node_set_enabled(&g_server->root_bg->node, 1);
-
-   print_server_info();
-
-   say(INFO, " -> Output %s : %dx%d+%d+%d", l_output->output->name,
-         output->usable_area.width, output->usable_area.height, 
-         output->usable_area.x, output->usable_area.y);
+   // The first commit is deferred, so that all outputs appearing together (e.g. docking) 
+   // are brought up with their profile in a single modeset
+   schedule_output_configure();
 }
-
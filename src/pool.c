@@ -0,0 +1,155 @@
+/*
+ * pool.c
+ *   - Typed object pools
+ *
+ * A slab is a header followed by as many objects as fit into POOL_SLAB bytes
+ * (at least POOL_SLAB_MIN). A free object holds the next free object in its
+ * first word; with POOL_DEBUG the rest of it is filled with POOL_POISON and a
+ * write after free is reported when the object is handed out again.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "pool.h"
+
+#define POOL_SLAB          4096
+#define POOL_SLAB_MIN      4
+#define POOL_POISON        0xa5
+
+struct pool_slab {
+   union {
+      struct pool_slab *next;
+      max_align_t align;      // keeps the objects behind the header aligned
+   };
+};
+
+static struct pool *pools;
+
+static size_t
+pool_stride(struct pool *pool)
+{
+   size_t align = _Alignof(max_align_t);
+   size_t size = pool->size < sizeof(void*) ? sizeof(void*) : pool->size;
+   return (size + align - 1) & ~(align - 1);
+}
+
+static bool
+pool_grow(struct pool *pool)
+{
+   size_t stride = pool_stride(pool);
+   size_t n = (POOL_SLAB - sizeof(struct pool_slab)) / stride;
+   if(n < POOL_SLAB_MIN) n = POOL_SLAB_MIN;
+
+   struct pool_slab *slab = malloc(sizeof(struct pool_slab) + n * stride);
+   if(!slab) return false;
+   slab->next = pool->slabs;
+   pool->slabs = slab;
+   pool->slab_count++;
+
+   // thread the new objects onto the free list, first object first
+   char *obj = (char*)(slab + 1);
+   for(size_t i=n; i-->0; ) {
+      void *o = obj + i * stride;
+#ifdef POOL_DEBUG
+      memset(o, POOL_POISON, stride);
+#endif
+      *(void**)o = pool->free;
+      pool->free = o;
+   }
+   return true;
+}
+
+#ifdef POOL_DEBUG
+static void
+pool_check_poison(struct pool *pool, void *obj)
+{
+   unsigned char *p = obj;
+   for(size_t i=sizeof(void*); i<pool->size; i++) {
+      if(p[i] != POOL_POISON) {
+         say(WARNING, "pool %s: object %p written after free (offset %zu)", pool->name, obj, i);
+         return;
+      }
+   }
+}
+#endif
+
+//------------------------------------------------------------------------
+void*
+pool_alloc(struct pool *pool)
+{
+   if(!pool->registered) {
+      pool->next = pools;
+      pools = pool;
+      pool->registered = true;
+   }
+
+   if(!pool->free && !pool_grow(pool)) return NULL;
+
+   void *obj = pool->free;
+   pool->free = *(void**)obj;
+#ifdef POOL_DEBUG
+   pool_check_poison(pool, obj);
+#endif
+   memset(obj, 0, pool->size);
+
+   pool->total++;
+   if(++pool->live > pool->peak) pool->peak = pool->live;
+   return obj;
+}
+
+void
+pool_free(struct pool *pool, void *obj)
+{
+   if(!obj) return;
+
+#ifdef POOL_DEBUG
+   memset(obj, POOL_POISON, pool->size);
+#endif
+   *(void**)obj = pool->free;
+   pool->free = obj;
+   pool->live--;
+}
+
+void
+pool_report(FILE *f)
+{
+   fprintf(f, "%-28s %6s %8s %8s %10s %6s %10s\n",
+         "pool", "size", "live", "peak", "total", "slabs", "bytes");
+   for(struct pool *pool = pools; pool; pool = pool->next) {
+      size_t stride = pool_stride(pool);
+      size_t n = (POOL_SLAB - sizeof(struct pool_slab)) / stride;
+      if(n < POOL_SLAB_MIN) n = POOL_SLAB_MIN;
+      fprintf(f, "%-28s %6zu %8llu %8llu %10llu %6llu %10llu\n", pool->name, pool->size,
+            (unsigned long long)pool->live, (unsigned long long)pool->peak,
+            (unsigned long long)pool->total, (unsigned long long)pool->slab_count,
+            (unsigned long long)(pool->slab_count * (sizeof(struct pool_slab) + n * stride)));
+   }
+#ifdef POOL_DEBUG
+   fprintf(f, "\nfreed objects are poisoned (pool_debug)\n");
+#endif
+}
+
+void
+pool_finish()
+{
+   // everything should have been returned by now, what is left has leaked
+   for(struct pool *pool = pools; pool; pool = pool->next) {
+      if(pool->live)
+         say(WARNING, "pool %s: %llu objects not freed", pool->name, (unsigned long long)pool->live);
+
+      struct pool_slab *slab, *next;
+      for(slab = pool->slabs; slab; slab = next) {
+         next = slab->next;
+         free(slab);
+      }
+      pool->slabs = NULL;
+      pool->free = NULL;
+      pool->slab_count = 0;
+      pool->live = 0;
+      pool->registered = false;
+   }
+   pools = NULL;
+}
@@ -0,0 +1,152 @@
+/*
+ * popup.c
+ *   - xdg popups of toplevels and layer surfaces
+ *
+ * Every popup gets its own simple_popup with commit, reposition and destroy
+ * listeners, so nested and concurrent popups (submenus, a completion list
+ * next to a tooltip) are all placed and unconstrained. Menus open and close
+ * all the time, so popups come from a pool (pool.c).
+ */
+
+#include <wlr/types/wlr_layer_shell_v1.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+#include "globals.h"
+#include "layer.h"
+#include "client.h"
+#include "server.h"
+#include "output.h"
+#include "popup.h"
+#include "pool.h"
+
+POOL(popup_pool, simple_popup);
+
+static struct wl_list popups;    // live popups
+
+//--- Placement ----------------------------------------------------------
+static bool
+popup_resolve(struct simple_popup *popup)
+{
+   // the parent is a toplevel, a layer surface or a popup resolved before
+   struct wlr_surface *parent = popup->xdg_popup->parent;
+   if(!parent) return false;
+
+   struct wlr_xdg_surface *xdg_parent = wlr_xdg_surface_try_from_wlr_surface(parent);
+   if(xdg_parent && xdg_parent->role == WLR_XDG_SURFACE_ROLE_POPUP) {
+      struct simple_popup *up = xdg_parent->data;
+      if(up) {
+         popup->client = up->client;
+         popup->lsurface = up->lsurface;
+      }
+   } else if(xdg_parent && xdg_parent->role == WLR_XDG_SURFACE_ROLE_TOPLEVEL) {
+      popup->client = xdg_parent->data;
+   } else {
+      struct wlr_layer_surface_v1 *ls = wlr_layer_surface_v1_try_from_wlr_surface(parent);
+      if(ls) popup->lsurface = ls->data;
+   }
+   return popup->client || popup->lsurface;
+}
+
+static void
+popup_unconstrain(struct simple_popup *popup)
+{
+   // the box is in the coordinates of the root toplevel or layer surface
+   struct simple_output *output = popup->client ? popup->client->output : popup->lsurface->output;
+   struct wlr_box *geom = popup->client ? &popup->client->geom : &popup->lsurface->geom;
+   if(!output) return;
+
+   struct wlr_box box = output->usable_area;
+   box.x -= geom->x;
+   box.y -= geom->y;
+   wlr_xdg_popup_unconstrain_from_box(popup->xdg_popup, &box);
+}
+
+//--- Listeners ----------------------------------------------------------
+static void
+popup_commit_notify(struct wl_listener *listener, void *data)
+{
+   struct simple_popup *popup = wl_container_of(listener, popup, commit);
+   struct wlr_xdg_popup *xdg_popup = popup->xdg_popup;
+   if(!xdg_popup->base->initial_commit) return;
+
+   // only the initial commit matters
+   wl_list_remove(&popup->commit.link);
+   wl_list_init(&popup->commit.link);
+
+   if(!popup_resolve(popup) || !xdg_popup->parent->data) return;
+
+   popup->scene_tree = wlr_scene_xdg_surface_create(xdg_popup->parent->data, xdg_popup->base);
+   xdg_popup->base->surface->data = popup->scene_tree;
+   popup_unconstrain(popup);
+}
+
+static void
+popup_reposition_notify(struct wl_listener *listener, void *data)
+{
+   say(DEBUG, "popup_reposition_notify");
+   struct simple_popup *popup = wl_container_of(listener, popup, reposition);
+   if(popup->scene_tree) popup_unconstrain(popup);
+}
+
+static void
+popup_destroy_notify(struct wl_listener *listener, void *data)
+{
+   say(DEBUG, "popup_destroy_notify");
+   struct simple_popup *popup = wl_container_of(listener, popup, destroy);
+
+   popup->xdg_popup->base->data = NULL;
+   wl_list_remove(&popup->commit.link);
+   wl_list_remove(&popup->reposition.link);
+   wl_list_remove(&popup->destroy.link);
+   wl_list_remove(&popup->link);
+   pool_free(&popup_pool, popup);
+}
+
+//------------------------------------------------------------------------
+void
+popup_init()
+{
+   wl_list_init(&popups);
+}
+
+void
+popup_unconstrain_children(struct simple_client *client, struct simple_layer_surface *lsurface)
+{
+   // the parent has moved: its popups may now stick out of the output
+   struct simple_popup *popup;
+   wl_list_for_each(popup, &popups, link) {
+      if(!popup->scene_tree) continue;
+      if((client && popup->client == client) || (lsurface && popup->lsurface == lsurface))
+         popup_unconstrain(popup);
+   }
+}
+
+void
+popup_owner_destroy(struct simple_client *client, struct simple_layer_surface *lsurface)
+{
+   struct simple_popup *popup;
+   wl_list_for_each(popup, &popups, link) {
+      if((client && popup->client == client) || (lsurface && popup->lsurface == lsurface)) {
+         popup->client = NULL;
+         popup->lsurface = NULL;
+         popup->scene_tree = NULL;  // nothing left to place it against
+      }
+   }
+}
+
+void
+xdg_new_popup_notify(struct wl_listener *listener, void *data)
+{
+   say(DEBUG, "xdg_new_popup_notify");
+   struct wlr_xdg_popup *xdg_popup = data;
+
+   struct simple_popup *popup = pool_alloc(&popup_pool);
+   popup->xdg_popup = xdg_popup;
+   xdg_popup->base->data = popup;
+   wl_list_insert(&popups, &popup->link);
+
+   LISTEN(&xdg_popup->base->surface->events.commit, &popup->commit, popup_commit_notify);
+   LISTEN(&xdg_popup->events.reposition, &popup->reposition, popup_reposition_notify);
+   LISTEN(&xdg_popup->events.destroy, &popup->destroy, popup_destroy_notify);
+}
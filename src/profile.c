@@ -0,0 +1,168 @@
+/*
+ * profile.c
+ *   - Listener profiler (meson -Dprofiling=true)
+ *
+ * LISTEN() points every listener at a trampoline and records the real handler in
+ * a static descriptor per call site. wl_listener has no room for extra data, so
+ * a side table maps the listener address to its descriptor. The same trampoline
+ * feeds the tracer (meson -Dtracing=true).
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "globals.h"
+
+#if defined(PROFILING) || defined(TRACING)
+struct profile_slot {
+   struct wl_listener *listener;
+   struct profile_site *site;
+};
+
+static struct profile_site *sites;
+static struct profile_slot *slots;
+static size_t n_slots, n_used;
+
+static inline size_t
+slot_hash(struct wl_listener *listener)
+{
+   uintptr_t h = (uintptr_t)listener;
+   h ^= h >> 17;
+   h *= 0x9E3779B97F4A7C15ull;
+   return (size_t)(h >> 20);
+}
+
+static struct profile_slot*
+slot_find(struct wl_listener *listener)
+{
+   size_t i = slot_hash(listener) & (n_slots - 1);
+   while(slots[i].listener && slots[i].listener != listener)
+      i = (i + 1) & (n_slots - 1);
+   return &slots[i];
+}
+
+static void
+slot_grow()
+{
+   struct profile_slot *old = slots;
+   size_t old_n = n_slots;
+
+   n_slots = n_slots ? n_slots * 2 : 256;
+   if(!(slots = calloc(n_slots, sizeof(struct profile_slot))))
+      say(ERROR, "Cannot allocate profiler table");
+
+   for(size_t i=0; i<old_n; i++)
+      if(old[i].listener) *slot_find(old[i].listener) = old[i];
+   free(old);
+}
+
+static inline uint64_t
+now_ns()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+profile_trampoline(struct wl_listener *listener, void *data)
+{
+   // the handler may free the listener, so everything is read up front
+   struct profile_site *site = slot_find(listener)->site;
+   if(!site) return;
+
+   const char *prev = watchdog_enter(site->name);
+   uint64_t start = now_ns();
+   site->handler(listener, data);
+   uint64_t elapsed = now_ns() - start;
+   watchdog_leave(&prev);
+
+#ifdef TRACING
+   trace_complete(site->name, "listener", start, elapsed);
+#endif
+
+   site->calls++;
+   site->total_ns += elapsed;
+   if(elapsed > site->max_ns) site->max_ns = elapsed;
+
+   int bucket = elapsed ? 64 - __builtin_clzll(elapsed) : 0;
+   site->hist[MIN(bucket, PROFILE_BUCKETS-1)]++;
+}
+
+//------------------------------------------------------------------------
+void
+profile_listen(struct wl_signal *signal, struct wl_listener *listener, struct profile_site *site)
+{
+   if(!site->registered) {
+      site->registered = true;
+      site->next = sites;
+      sites = site;
+   }
+
+   // addresses of freed listeners are reused, so an existing slot is simply taken over
+   if(2 * (n_used + 1) > n_slots) slot_grow();
+   struct profile_slot *slot = slot_find(listener);
+   if(!slot->listener) n_used++;
+   slot->listener = listener;
+   slot->site = site;
+
+   listener->notify = profile_trampoline;
+   wl_signal_add(signal, listener);
+}
+
+static int
+site_compare(const void *a, const void *b)
+{
+   const struct profile_site *sa = *(struct profile_site* const*)a, *sb = *(struct profile_site* const*)b;
+   return sa->total_ns < sb->total_ns ? 1 : sa->total_ns > sb->total_ns ? -1 : 0;
+}
+
+void
+profile_report(FILE *f)
+{
+   size_t n = 0;
+   struct profile_site *site;
+   for(site = sites; site; site = site->next) n++;
+
+   struct profile_site **sorted = calloc(n ? n : 1, sizeof(*sorted));
+   if(!sorted) return;
+   n = 0;
+   for(site = sites; site; site = site->next) sorted[n++] = site;
+   qsort(sorted, n, sizeof(*sorted), site_compare);
+
+   fprintf(f, "%-36s %10s %12s %10s %10s  histogram (<=us:calls)\n", "listener", "calls", "total[ms]", "avg[us]", "max[us]");
+   for(size_t i=0; i<n; i++) {
+      site = sorted[i];
+      if(!site->calls) continue;
+
+      fprintf(f, "%-36s %10llu %12.3f %10.1f %10.1f ", site->name, (unsigned long long)site->calls,
+            site->total_ns/1e6, site->total_ns/1e3/site->calls, site->max_ns/1e3);
+      for(int b=0; b<PROFILE_BUCKETS; b++) {
+         if(site->hist[b]) fprintf(f, " %g:%llu", ((uint64_t)1 << b)/1e3, (unsigned long long)site->hist[b]);
+      }
+      fprintf(f, "\n");
+   }
+   free(sorted);
+}
+
+void
+profile_reset()
+{
+   for(struct profile_site *site = sites; site; site = site->next) {
+      site->calls = site->total_ns = site->max_ns = 0;
+      memset(site->hist, 0, sizeof(site->hist));
+   }
+}
+
+int
+profile_signal_notify(int sig, void *data)
+{
+   // SIGUSR1: dump the table to stderr (the log)
+   profile_report(stderr);
+   return 0;
+}
+#else
+void profile_report(FILE *f) { fprintf(f, "simplewc was built without -Dprofiling=true or -Dtracing=true\n"); }
+void profile_reset() {}
+int profile_signal_notify(int sig, void *data) { return 0; }
+#endif
@@ -34,6 +34,7 @@
 #include <wlr/types/wlr_fractional_scale_v1.h>
 #include <wlr/types/wlr_xdg_activation_v1.h>
 #include <wlr/types/wlr_tablet_v2.h>
+#include <wlr/types/wlr_tearing_control_v1.h>
 //#include <wlr/types/wlr_foreign_toplevel_management_v1.h>
 //#include <wlr/types/wlr_ext_foreign_toplevel_list_v1.h>
 
@@ -45,6 +46,13 @@
 #include "server.h"
 #include "input.h"
 #include "ipc.h"
+#include "wallpaper.h"
+#include "launch.h"
+#include "worker.h"
+#include "popup.h"
+#include "pool.h"
+
+POOL(outline_pool, simple_outline);
 
 //--- client outline procedures ------------------------------------------
 static void
@@ -52,13 +60,13 @@ simple_outline_destroy_notify(struct wl_listener *listener, void *data)
 {
    struct simple_outline* outline = wl_container_of(listener, outline, destroy);
    wl_list_remove(&outline->destroy.link);
-   free(outline);
+   pool_free(&outline_pool, outline);
 }
 
 struct simple_outline*
 simple_outline_create(struct wlr_scene_tree *parent, float* border_colour, int line_width)
 {
-   struct simple_outline* outline = calloc(1, sizeof(struct simple_outline));
+   struct simple_outline* outline = pool_alloc(&outline_pool);
    outline->line_width = line_width;
    outline->tree = wlr_scene_tree_create(parent);
 
@@ -94,25 +102,32 @@ simple_outline_set_size(struct simple_outline* outline, int width, int height) {
 void
 setCurrentTag(int tag, bool toggle)
 {
-   if(toggle)
-      g_server->visible_tags ^= TAGMASK(tag);
-   else 
-      g_server->visible_tags = g_server->current_tag = TAGMASK(tag);
+   struct simple_output *output = g_server->cur_output;
+   if(!output || tag<0 || tag>=g_config->n_tags) return;
 
-   print_server_info();
+   if(toggle) {
+      tagset_toggle(&output->visible_tags, tag);
+   } else {
+      tagset_single(&output->visible_tags, tag);
+      tagset_single(&output->current_tag, tag);
+   }
+
+   // other outputs keep their tags, so only this one's status changes
+   ipc_output_printstatus(output);
 }
 
 void
 tileTag() 
 {
    // TODO: Needs to tile per output
+   TRACE_SCOPE("tileTag");
    struct simple_client* client;
    struct simple_output* output = g_server->cur_output;
    
    // first count the number of clients
    int n=0;
    wl_list_for_each(client, &g_server->clients, link){
-      if(!(client->visible && client->output==output && (client->fixed || (client->tag & g_server->visible_tags)))) continue;
+      if(!(client->visible && client->output==output && is_client_tag_visible(client))) continue;
       n++;
    }
 
@@ -122,7 +137,7 @@ tileTag()
    int i=0;
    struct wlr_box new_geom;
    wl_list_for_each(client, &g_server->clients, link){
-      if(!(client->visible && client->output==output && (client->fixed || (client->tag & g_server->visible_tags)))) continue;
+      if(!(client->visible && client->output==output && is_client_tag_visible(client))) continue;
       
       if(i==0) { // master window
          new_geom.x = output->usable_area.x + gap_width + bw;
@@ -155,7 +170,8 @@ print_server_info()
    wl_list_for_each(output, &g_server->outputs, link) {
       ipc_output_printstatus(output);
       say(DEBUG, "output %s (%s)", output->wlr_output->name, output == g_server->cur_output?"*":"");
-      say(DEBUG, " -> tag = vis:%u / cur:%u", g_server->visible_tags, g_server->current_tag);
+      say(DEBUG, " -> tag = vis:%#llx / cur:%#llx (first 64)", 
+            (unsigned long long)output->visible_tags.word, (unsigned long long)output->current_tag.word);
       wl_list_for_each(client, &g_server->clients, link) {
          struct simple_client* focused_client=NULL;
          get_client_from_surface(g_server->seat->keyboard_state.focused_surface, &focused_client, NULL);
@@ -163,7 +179,7 @@ print_server_info()
 
          say(DEBUG, " -> client (%s/%s)", client->visible?"visible":"hidden", client==focused_client?"focused":"unfocused");
          say(DEBUG, "    -> client title = %s", get_client_title(client));
-         say(DEBUG, "    -> client tag = %u", client->tag);
+         say(DEBUG, "    -> client tag = %#llx (first 64)", (unsigned long long)client->tag.word);
          say(DEBUG, "    -> client fixed/fullscreen/urgent = %b/%b/%b", 
                               client->fixed, client->fullscreen, client->urgent);
       }
@@ -223,11 +239,15 @@ output_pm_set_mode_notify(struct wl_listener *listener, void *data)
 {
    say(DEBUG, "output_pm_set_mode_notify");
    struct wlr_output_power_v1_set_mode_event *event = data;
+   struct simple_output *output = event->output->data;
    struct wlr_output_state wlr_state = {0};
 
    wlr_output_state_set_enabled(&wlr_state, event->mode);
    wlr_output_commit_state(event->output, &wlr_state);
 
+   if(output)
+      output_set_power(output, event->mode==ZWLR_OUTPUT_POWER_V1_MODE_ON ? POWER_ON : POWER_OFF);
+
    // reset the cursor image
    wlr_cursor_unset_image(g_server->cursor);
    wlr_cursor_set_xcursor(g_server->cursor, g_server->cursor_manager, "left_ptr");;
@@ -242,6 +262,7 @@ urgent_notify(struct wl_listener *listener, void *data)
    struct simple_client* client = NULL;
    struct simple_layer_surface* lsurface = NULL; 
    get_client_from_surface(event->surface, &client, &lsurface); 
+   launch_activate(event->token, client);
 
    struct simple_client* focused_client = get_top_client_from_output(g_server->cur_output, false);
    if(!client || client == focused_client) return;
@@ -314,6 +335,9 @@ unlock_session_notify(struct wl_listener *listener, void *data)
 
    wlr_scene_node_set_enabled(&g_server->locked_bg->node, 0);
    //focus_client()
+
+   // clients were held back while locked; let them draw again
+   output_resume_frames();
 }
 
 static void
@@ -371,14 +395,14 @@ static void
 output_manager_apply_notify(struct wl_listener *listener, void *data) 
 {
    say(DEBUG, "output_manager_apply_notify");
-   //
+   output_manager_apply(data, false);
 }
 
 static void 
 output_manager_test_notify(struct wl_listener *listener, void *data) 
 {
    say(DEBUG, "output_manager_test_notify");
-   //
+   output_manager_apply(data, true);
 }
 
 //------------------------------------------------------------------------
@@ -390,6 +414,9 @@ prepareServer()
    g_server->display = wl_display_create();
    g_server->event_loop = wl_display_get_event_loop(g_server->display);
 
+   // threads for blocking work (keymaps, wallpaper), see worker.c
+   worker_init();
+
    if(!(g_server->backend = wlr_backend_autocreate(g_server->event_loop, &g_session)))
       say(ERROR, "Unable to create wlr_backend!");
 
@@ -487,9 +514,14 @@ prepareServer()
    g_server->output_power_manager = wlr_output_power_manager_v1_create(g_server->display);
    LISTEN(&g_server->output_power_manager->events.set_mode, &g_server->output_pm_set_mode, output_pm_set_mode_notify);
 
+   // set up tearing control - hints are queried per frame in output_frame_notify()
+   g_server->tearing_control_manager = wlr_tearing_control_manager_v1_create(g_server->display, TEARING_CONTROL_VERSION);
+
    // set initial background - will be updated when output is changed
    g_server->root_bg = wlr_scene_rect_create(g_server->layer_tree[LyrBg], 1, 1, g_config->background_colour);
    wlr_scene_node_set_enabled(&g_server->root_bg->node, 0);
+   wallpaper_init();
+   popup_init();
 
    // Use decoration protocols to negotiate server-side decorations
    wlr_server_decoration_manager_set_default_mode(wlr_server_decoration_manager_create(g_server->display),
@@ -507,16 +539,37 @@ prepareServer()
    g_server->tablet_manager = wlr_tablet_v2_create(g_server->display);
    wl_list_init(&g_server->tablet_tools);
 
-   // set default tag 
-   g_server->current_tag = TAGMASK(0);
-   g_server->visible_tags = TAGMASK(0);
+   // reap children started with spawn()
+   spawn_init();
 
    // Set up IPC interface
    wl_global_create(g_server->display, &zdwl_ipc_manager_v2_interface, DWL_IPC_VERSION, NULL, ipc_manager_bind);
 
+#ifdef PROFILING
+   // print the listener profile on SIGUSR1
+   wl_event_loop_add_signal(g_server->event_loop, SIGUSR1, profile_signal_notify, NULL);
+#endif
+#ifdef TRACING
+   // dump the trace ring on SIGUSR2
+   wl_event_loop_add_signal(g_server->event_loop, SIGUSR2, trace_signal_notify, NULL);
+#endif
+
 #if XWAYLAND
-   if(!(g_server->xwayland = wlr_xwayland_create(g_server->display, g_server->compositor, true))) {
+   // xwayland_mode: the server is ours, so wlroots can stop it when idle and bring it
+   // back on the next X11 connection; every start ends in xwl_ready_notify()
+   struct wlr_xwayland_server_options options = {
+      .lazy = g_config->xwayland_mode != XWL_EAGER,
+      .enable_wm = true,
+      .terminate_delay = g_config->xwayland_mode == XWL_IDLE_EXIT ? g_config->xwayland_idle_exit : 0,
+   };
+   if(!(g_server->xwayland_server = wlr_xwayland_server_create(g_server->display, &options))) {
+      say(WARNING, "unable to create xwayland server. Continuing without it");
+      return;
+   }
+   if(!(g_server->xwayland = wlr_xwayland_create_with_server(g_server->display, g_server->compositor, g_server->xwayland_server))) {
       say(WARNING, "unable to create xwayland server. Continuing without it");
+      wlr_xwayland_server_destroy(g_server->xwayland_server);
+      g_server->xwayland_server = NULL;
       return;
    }
 
@@ -541,32 +594,52 @@ startServer()
       say(ERROR, "Unable to start WLR backend!");
    }
    
+   // bring up the outputs found by the backend in one go
+   output_configure_pending();
+   output_relayout_flush();
+
    setenv("WAYLAND_DISPLAY", socket, true);
    say(INFO, " -> Wayland server is running on WAYLAND_DISPLAY=%s ...", socket);
 
 #if XWAYLAND
-   setenv("DISPLAY", g_server->xwayland->display_name, true);
-   say(INFO, " -> XWayland is running on display %s", g_server->xwayland->display_name);
+   if(g_server->xwayland) {
+      setenv("DISPLAY", g_server->xwayland->display_name, true);
+      say(INFO, " -> XWayland is running on display %s", g_server->xwayland->display_name);
+   }
 #endif
 
    // choose initial output based on cursor position
    g_server->cur_output = get_output_at(g_server->cursor->x, g_server->cursor->y);
+
+   // watch for event-loop stalls (watchdog_threshold)
+   watchdog_init();
 }
 
 void 
 cleanupServer() 
 {
    say(INFO, "Cleaning up Wayland server");
+   watchdog_finish();
+   worker_finish();
 
 #if XWAYLAND
-   wl_list_remove(&g_server->xwl_new_surface.link);
-   wl_list_remove(&g_server->xwl_ready.link);
+   if(g_server->xwayland) {
+      wl_list_remove(&g_server->xwl_new_surface.link);
+      wl_list_remove(&g_server->xwl_ready.link);
 
-   wlr_xwayland_destroy(g_server->xwayland);
+      // the server was created separately and outlives the xwayland handle
+      wlr_xwayland_destroy(g_server->xwayland);
+      wlr_xwayland_server_destroy(g_server->xwayland_server);
+   }
    g_server->xwayland = NULL;
+   g_server->xwayland_server = NULL;
 #endif
 
    wl_display_destroy_clients(g_server->display);
+   wallpaper_finish();
+   input_finish();
+   spawn_finish();
+   launch_finish();
 
    wl_list_remove(&g_server->new_input.link);
 
@@ -577,6 +650,9 @@ cleanupServer()
    wl_list_remove(&g_server->output_layout_change.link);
    wl_list_remove(&g_server->output_manager_apply.link);
    wl_list_remove(&g_server->output_manager_test.link);
+   if(g_server->output_relayout_timer)
+      wl_event_source_remove(g_server->output_relayout_timer);
+   g_server->output_relayout_timer = NULL;
 
    wl_list_remove(&g_server->request_activate.link);
 
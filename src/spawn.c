@@ -0,0 +1,192 @@
+/*
+ * spawn.c
+ *   - Starting and reaping child processes
+ *
+ * Children are started with posix_spawn, which does not copy the compositor's
+ * address space the way fork() does. They get stdout on stderr, a new session,
+ * default signal handling, and no fds other than stdin, stdout and stderr.
+ * Commands without shell syntax are run directly instead of through $SHELL.
+ * Exits are reaped on the event loop (signalfd), and only for the children
+ * started here, so the Xwayland server started by wlroots is left alone.
+ */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "globals.h"
+#include "server.h"
+#include "launch.h"
+
+#define SPAWN_MAX_ARGS 32
+
+extern char **environ;
+
+static struct wl_list children;
+static struct wl_event_source *sigchld_source;
+
+static uint64_t
+now_ns()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool
+needs_shell(const char *cmd)
+{
+   // quoting, expansion, redirection, job control, VAR=value prefixes, ...
+   return strpbrk(cmd, "\"'\\$`|&;<>()*?[]{}~=#%!\n") != NULL;
+}
+
+static int
+split_args(char *buffer, char **argv)
+{
+   // 0 when there are no words or too many: the command then goes through $SHELL
+   int argc = 0;
+   for(char *arg = strtok(buffer, " \t"); arg; arg = strtok(NULL, " \t")) {
+      if(argc == SPAWN_MAX_ARGS) return 0;
+      argv[argc++] = arg;
+   }
+   argv[argc] = NULL;
+   return argc;
+}
+
+static char**
+child_environment(char *token_env)
+{
+   // environ with our XDG_ACTIVATION_TOKEN, which lets the new window be matched to the launch
+   size_t n = 0;
+   while(environ[n]) n++;
+   char **envp = calloc(n + 2, sizeof(char*));
+   if(!envp) return NULL;
+
+   size_t i = 0;
+   for(size_t j=0; j<n; j++) {
+      if(strncmp(environ[j], "XDG_ACTIVATION_TOKEN=", 21)) envp[i++] = environ[j];
+   }
+   envp[i] = token_env;
+   return envp;
+}
+
+static int
+sigchld_notify(int sig, void *data)
+{
+   // SIGCHLD is coalesced, so every tracked child is polled
+   struct simple_child *child, *tmp;
+   wl_list_for_each_safe(child, tmp, &children, link) {
+      int status;
+      if(waitpid(child->pid, &status, WNOHANG) != child->pid) continue;
+
+      say(DEBUG, "pid %d (%s) exited with status %d after %.1f s", child->pid, child->cmd,
+            WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status),
+            (now_ns() - child->start) / 1e9);
+      wl_list_remove(&child->link);
+      free(child->cmd);
+      free(child);
+   }
+   return 0;
+}
+
+//------------------------------------------------------------------------
+pid_t
+spawn(const char *cmd)
+{
+   say(DEBUG, "Spawn %s", cmd);
+
+   char *buffer = strdup(cmd);
+   char *argv[SPAWN_MAX_ARGS + 1];
+   const char *sh = getenv("SHELL");
+   if(!sh) sh = "/bin/sh";
+
+   if(needs_shell(cmd) || !split_args(buffer, argv)) {
+      argv[0] = (char*)sh;
+      argv[1] = (char*)"-c";
+      argv[2] = (char*)cmd;
+      argv[3] = NULL;
+   }
+
+   posix_spawn_file_actions_t actions;
+   posix_spawn_file_actions_init(&actions);
+   posix_spawn_file_actions_adddup2(&actions, STDERR_FILENO, STDOUT_FILENO);
+#ifdef HAVE_SPAWN_CLOSEFROM
+   // DRM, input and client fds that were not opened with O_CLOEXEC
+   posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+#endif
+
+   posix_spawnattr_t attr;
+   posix_spawnattr_init(&attr);
+   sigset_t mask;
+   sigemptyset(&mask);
+   posix_spawnattr_setsigmask(&attr, &mask);  // SIGCHLD is blocked for the signalfd
+   sigfillset(&mask);
+   posix_spawnattr_setsigdefault(&attr, &mask);
+   short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_SETSID
+   flags |= POSIX_SPAWN_SETSID;
+#endif
+   posix_spawnattr_setflags(&attr, flags);
+
+   struct launch *launch = launch_begin(cmd);
+   char *token_env = NULL;
+   if(launch_token(launch) && asprintf(&token_env, "XDG_ACTIVATION_TOKEN=%s", launch_token(launch)) < 0)
+      token_env = NULL;
+   char **envp = token_env ? child_environment(token_env) : NULL;
+
+   pid_t pid;
+   int err = posix_spawnp(&pid, argv[0], &actions, &attr, argv, envp ? envp : environ);
+   posix_spawnattr_destroy(&attr);
+   posix_spawn_file_actions_destroy(&actions);
+   free(buffer);
+   free(envp);
+   free(token_env);
+
+   launch_started(launch, err ? -1 : pid);
+   if(err) {
+      say(WARNING, "Unable to spawn %s: %s", cmd, strerror(err));
+      return -1;
+   }
+
+   struct simple_child *child = calloc(1, sizeof(struct simple_child));
+   child->pid = pid;
+   child->cmd = strdup(cmd);
+   child->start = now_ns();
+   wl_list_insert(&children, &child->link);
+   return pid;
+}
+
+struct simple_child*
+spawn_find(pid_t pid)
+{
+   struct simple_child *child;
+   wl_list_for_each(child, &children, link) {
+      if(child->pid == pid) return child;
+   }
+   return NULL;
+}
+
+void
+spawn_init()
+{
+   wl_list_init(&children);
+   sigchld_source = wl_event_loop_add_signal(g_server->event_loop, SIGCHLD, sigchld_notify, NULL);
+}
+
+void
+spawn_finish()
+{
+   if(sigchld_source) wl_event_source_remove(sigchld_source);
+   sigchld_source = NULL;
+
+   // the children keep running, only the bookkeeping goes
+   struct simple_child *child, *tmp;
+   wl_list_for_each_safe(child, tmp, &children, link) {
+      wl_list_remove(&child->link);
+      free(child->cmd);
+      free(child);
+   }
+}
@@ -0,0 +1,139 @@
+/*
+ * trace.c
+ *   - Timeline tracer (meson -Dtracing=true)
+ *
+ * Events go into a fixed ring buffer owned by the main thread, so recording is
+ * a couple of stores. trace_dump() writes the ring as Chrome trace-event JSON.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "globals.h"
+
+#ifdef TRACING
+#define TRACE_RING_SIZE (1 << 16)
+
+struct trace_event {
+   const char *name;
+   const char *cat;
+   uint64_t ts;      // ns, CLOCK_MONOTONIC as used by client-side traces
+   uint64_t dur;     // ns, complete events only
+   uint32_t client;  // client pid, instant events only
+   uint32_t serial;
+   char phase;       // 'X' complete, 'i' instant
+};
+
+static struct trace_event ring[TRACE_RING_SIZE];
+static uint64_t head;
+
+uint64_t
+trace_now()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline struct trace_event*
+trace_next()
+{
+   return &ring[head++ & (TRACE_RING_SIZE - 1)];
+}
+
+void
+trace_complete(const char *name, const char *cat, uint64_t start, uint64_t dur)
+{
+   struct trace_event *ev = trace_next();
+   *ev = (struct trace_event){ .name = name, .cat = cat, .ts = start, .dur = dur, .phase = 'X' };
+}
+
+void
+trace_instant(const char *name, uint32_t client, uint32_t serial)
+{
+   struct trace_event *ev = trace_next();
+   *ev = (struct trace_event){ .name = name, .cat = "client", .ts = trace_now(), 
+      .client = client, .serial = serial, .phase = 'i' };
+}
+
+struct trace_scope
+trace_scope_begin(const char *name)
+{
+   return (struct trace_scope){ .name = name, .start = trace_now() };
+}
+
+void
+trace_scope_end(struct trace_scope *scope)
+{
+   trace_complete(scope->name, "compositor", scope->start, trace_now() - scope->start);
+}
+
+static void
+trace_write(FILE *f)
+{
+   int pid = getpid();
+   uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+   fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+   fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"simplewc\"}}", pid);
+   for(uint64_t i=first; i<head; i++) {
+      struct trace_event *ev = &ring[i & (TRACE_RING_SIZE - 1)];
+      fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+            ev->name, ev->cat, ev->phase, ev->ts/1e3, pid, pid);
+      if(ev->phase == 'X')
+         fprintf(f, ",\"dur\":%.3f}", ev->dur/1e3);
+      else
+         fprintf(f, ",\"s\":\"t\",\"args\":{\"client_pid\":%u,\"serial\":%u}}", ev->client, ev->serial);
+   }
+   fprintf(f, "\n]}\n");
+}
+#else
+static void
+trace_write(FILE *f)
+{
+   fprintf(f, "{\"traceEvents\":[]}\n");
+   say(WARNING, "simplewc was built without -Dtracing=true, the trace is empty");
+}
+#endif
+
+//------------------------------------------------------------------------
+void
+trace_dump(const char *name)
+{
+   // The name comes from any dwl-ipc client, so it is only a file name inside
+   // $XDG_RUNTIME_DIR and never replaces an existing file. The default
+   // simplewc-trace.json is our own and is overwritten.
+   int flags = O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC;
+   if(!name || !name[0]) {
+      name = "simplewc-trace.json";
+      flags |= O_TRUNC;
+   } else if(strchr(name, '/') || name[0] == '.') {
+      say(WARNING, "trace_dump: '%s' is not a plain file name", name);
+      return;
+   } else {
+      flags |= O_EXCL;
+   }
+
+   char path[256];
+   snprintf(path, sizeof path, "%s/%s", getenv("XDG_RUNTIME_DIR"), name);
+
+   int fd = open(path, flags, 0600);
+   FILE *f = fd < 0 ? NULL : fdopen(fd, "w");
+   if(!f) {
+      if(fd >= 0) close(fd);
+      say(WARNING, "Unable to write trace %s", path);
+      return;
+   }
+   trace_write(f);
+   fclose(f);
+   say(INFO, "Trace written to %s", path);
+}
+
+int
+trace_signal_notify(int sig, void *data)
+{
+   trace_dump(NULL);
+   return 0;
+}
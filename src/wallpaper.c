@@ -0,0 +1,326 @@
+#include <drm_fourcc.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/box.h>
+#ifdef HAVE_CAIRO
+#include <cairo.h>
+#endif
+
+#include "globals.h"
+#include "server.h"
+#include "output.h"
+#include "wallpaper.h"
+#include "worker.h"
+
+// The image is decoded once and scaled to the pixel size of each output on the
+// worker pool. Outputs of the same size share one buffer.
+
+struct wallpaper_buffer {
+   struct wlr_buffer base;
+   void *data;
+   size_t stride;
+};
+
+struct wallpaper_job {
+   struct wallpaper_size *size;     // only touched on the event loop
+   int width, height;
+   struct wallpaper_buffer *result;
+};
+
+static struct wl_list sizes;
+
+//--- wlr_buffer implementation ------------------------------------------
+static void
+wallpaper_buffer_destroy(struct wlr_buffer *wlr_buffer)
+{
+   struct wallpaper_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+   wlr_buffer_finish(wlr_buffer);
+   free(buffer->data);
+   free(buffer);
+}
+
+static bool
+wallpaper_buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer, uint32_t flags,
+      void **data, uint32_t *format, size_t *stride)
+{
+   struct wallpaper_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+   if(flags & WLR_BUFFER_DATA_PTR_ACCESS_WRITE) return false;
+
+   *data = buffer->data;
+   *format = DRM_FORMAT_ARGB8888;
+   *stride = buffer->stride;
+   return true;
+}
+
+static void
+wallpaper_buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer)
+{
+   // nothing to do, the data is read-only
+}
+
+static const struct wlr_buffer_impl wallpaper_buffer_impl = {
+   .destroy = wallpaper_buffer_destroy,
+   .begin_data_ptr_access = wallpaper_buffer_begin_data_ptr_access,
+   .end_data_ptr_access = wallpaper_buffer_end_data_ptr_access,
+};
+
+//--- Worker -------------------------------------------------------------
+#ifdef HAVE_CAIRO
+// decoded image, only touched by workers while holding source_lock
+static pthread_mutex_t source_lock = PTHREAD_MUTEX_INITIALIZER;
+static cairo_surface_t *source;
+static bool source_failed;
+
+static cairo_surface_t*
+wallpaper_source()
+{
+   if(source || source_failed) return source;
+
+   char path[PATH_MAX];
+   const char *home = getenv("HOME");
+   if(!strncmp(g_config->wallpaper, "~/", 2) && home)
+      snprintf(path, sizeof path, "%s/%s", home, g_config->wallpaper+2);
+   else
+      snprintf(path, sizeof path, "%s", g_config->wallpaper);
+
+   source = cairo_image_surface_create_from_png(path);
+   if(cairo_surface_status(source) != CAIRO_STATUS_SUCCESS) {
+      cairo_surface_destroy(source);
+      source = NULL;
+      source_failed = true;
+   }
+   return source;
+}
+
+static struct wallpaper_buffer*
+wallpaper_render(int width, int height)
+{
+   cairo_surface_t *image = wallpaper_source();
+   if(!image) return NULL;
+
+   int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+   void *data = calloc(height, stride);
+   if(!data) return NULL;
+
+   cairo_surface_t *target = cairo_image_surface_create_for_data(data, CAIRO_FORMAT_ARGB32, width, height, stride);
+   cairo_t *cr = cairo_create(target);
+
+   float *bg = g_config->background_colour;
+   cairo_set_source_rgba(cr, bg[0], bg[1], bg[2], bg[3]);
+   cairo_paint(cr);
+
+   double iw = cairo_image_surface_get_width(image);
+   double ih = cairo_image_surface_get_height(image);
+   double sx = width / iw, sy = height / ih;
+   switch(g_config->wallpaper_mode) {
+      case WP_FILL:     sx = sy = MAX(sx, sy); break;
+      case WP_FIT:      sx = sy = MIN(sx, sy); break;
+      case WP_STRETCH:  break;
+      case WP_CENTER:
+      case WP_TILE:     sx = sy = 1.; break;
+   }
+
+   if(g_config->wallpaper_mode != WP_TILE)
+      cairo_translate(cr, (width - iw*sx)/2, (height - ih*sy)/2);
+   cairo_scale(cr, sx, sy);
+   cairo_set_source_surface(cr, image, 0, 0);
+
+   cairo_pattern_t *pattern = cairo_get_source(cr);
+   cairo_pattern_set_filter(pattern, CAIRO_FILTER_GOOD);
+   if(g_config->wallpaper_mode == WP_TILE)
+      cairo_pattern_set_extend(pattern, CAIRO_EXTEND_REPEAT);
+   cairo_paint(cr);
+
+   cairo_destroy(cr);
+   cairo_surface_flush(target);
+   cairo_surface_destroy(target);
+
+   struct wallpaper_buffer *buffer = calloc(1, sizeof(struct wallpaper_buffer));
+   buffer->data = data;
+   buffer->stride = stride;
+   return buffer;
+}
+
+static void
+wallpaper_worker(void *data)
+{
+   // the pool may run several sizes at once, the source is decoded by the first
+   struct wallpaper_job *job = data;
+
+   pthread_mutex_lock(&source_lock);
+   job->result = wallpaper_render(job->width, job->height);
+   pthread_mutex_unlock(&source_lock);
+}
+
+static void wallpaper_done(void*);
+
+static void
+wallpaper_queue(struct wallpaper_size *size)
+{
+   struct wallpaper_job *job = calloc(1, sizeof(struct wallpaper_job));
+   job->size = size;
+   job->width = size->width;
+   job->height = size->height;
+   size->pending = true;
+   worker_submit(wallpaper_worker, wallpaper_done, job);
+}
+#else
+static void
+wallpaper_queue(struct wallpaper_size *size)
+{
+   static bool warned;
+   if(!warned) say(WARNING, "simplewc was built without cairo, wallpaper = %s is ignored", g_config->wallpaper);
+   warned = true;
+}
+#endif
+
+//--- Sizes --------------------------------------------------------------
+static struct wallpaper_size*
+wallpaper_size_get(int width, int height)
+{
+   struct wallpaper_size *size;
+   wl_list_for_each(size, &sizes, link) {
+      if(size->width == width && size->height == height) return size;
+   }
+
+   size = calloc(1, sizeof(struct wallpaper_size));
+   size->width = width;
+   size->height = height;
+   wl_list_insert(&sizes, &size->link);
+   wallpaper_queue(size);
+   return size;
+}
+
+static void
+wallpaper_size_evict()
+{
+   // a size nobody shows any more is dropped once its worker has returned
+   struct wallpaper_size *size, *tmp;
+   wl_list_for_each_safe(size, tmp, &sizes, link) {
+      if(size->users || size->pending) continue;
+      if(size->buffer) wlr_buffer_drop(&size->buffer->base);
+      wl_list_remove(&size->link);
+      free(size);
+   }
+}
+
+static void
+wallpaper_output_show(struct simple_output *output)
+{
+   struct wallpaper_size *size = output->wallpaper_size;
+   if(!size || !size->buffer) return; // keep the previous image until the new one is ready
+
+   wlr_scene_buffer_set_buffer(output->wallpaper, &size->buffer->base);
+   wlr_scene_buffer_set_dest_size(output->wallpaper, output->full_area.width, output->full_area.height);
+}
+
+#ifdef HAVE_CAIRO
+static void
+wallpaper_done(void *data)
+{
+   struct wallpaper_job *job = data;
+   struct wallpaper_size *size = job->size;
+   size->pending = false;
+
+   if(!job->result) {
+      say(WARNING, "Unable to load wallpaper %s", g_config->wallpaper);
+   } else {
+      size->buffer = job->result;
+      wlr_buffer_init(&size->buffer->base, &wallpaper_buffer_impl, size->width, size->height);
+
+      struct simple_output *output;
+      wl_list_for_each(output, &g_server->outputs, link) {
+         if(output->wallpaper_size == size) wallpaper_output_show(output);
+      }
+   }
+   free(job);
+
+   wallpaper_size_evict();
+}
+#endif
+
+static bool
+wallpaper_accepts_input(struct wlr_scene_buffer *buffer, double *sx, double *sy)
+{
+   // clicks go through to the root window as with the plain background
+   return false;
+}
+
+//------------------------------------------------------------------------
+void
+wallpaper_init()
+{
+   wl_list_init(&sizes);
+}
+
+void
+wallpaper_finish()
+{
+   // called after worker_finish(), which has reported every job
+   struct wallpaper_size *size, *tmp;
+   wl_list_for_each_safe(size, tmp, &sizes, link) {
+      if(size->buffer) wlr_buffer_drop(&size->buffer->base);
+      wl_list_remove(&size->link);
+      free(size);
+   }
+
+#ifdef HAVE_CAIRO
+   if(source) cairo_surface_destroy(source);
+   source = NULL;
+   source_failed = false;
+#endif
+}
+
+void
+wallpaper_update_outputs()
+{
+   if(!g_config->wallpaper[0]) return;
+
+   struct simple_output *output;
+   wl_list_for_each(output, &g_server->outputs, link) {
+      struct wallpaper_size *size = NULL;
+
+      if(output->wlr_output->enabled && !wlr_box_empty(&output->full_area)) {
+         int width, height;
+         wlr_output_transformed_resolution(output->wlr_output, &width, &height);
+         size = wallpaper_size_get(width, height);
+      }
+
+      if(!output->wallpaper) {
+         output->wallpaper = wlr_scene_buffer_create(g_server->layer_tree[LyrBg], NULL);
+         output->wallpaper->point_accepts_input = wallpaper_accepts_input;
+         wlr_scene_node_place_above(&output->wallpaper->node, &g_server->root_bg->node);
+      }
+
+      if(size != output->wallpaper_size) {
+         if(output->wallpaper_size) output->wallpaper_size->users--;
+         if(size) size->users++;
+         output->wallpaper_size = size;
+      }
+
+      wlr_scene_node_set_enabled(&output->wallpaper->node, size != NULL);
+      if(!size) continue;
+
+      wlr_scene_node_set_position(&output->wallpaper->node, output->full_area.x, output->full_area.y);
+      wlr_scene_buffer_set_dest_size(output->wallpaper, output->full_area.width, output->full_area.height);
+      wallpaper_output_show(output);
+   }
+
+   wallpaper_size_evict();
+}
+
+void
+wallpaper_output_destroy(struct simple_output *output)
+{
+   if(output->wallpaper_size) output->wallpaper_size->users--;
+   output->wallpaper_size = NULL;
+
+   if(output->wallpaper) wlr_scene_node_destroy(&output->wallpaper->node);
+   output->wallpaper = NULL;
+
+   wallpaper_size_evict();
+}
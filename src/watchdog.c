@@ -0,0 +1,269 @@
+/*
+ * watchdog.c
+ *   - Event-loop stall watchdog
+ *
+ * A timer on the event loop stamps the heartbeat every threshold/4. The watchdog
+ * thread wakes at the same rate; when the heartbeat is older than the threshold
+ * the loop is stuck, and watchdog_active says in what. The stall is measured when
+ * the heartbeat resumes.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_EXECINFO
+#include <execinfo.h>
+#endif
+
+#include "globals.h"
+#include "server.h"
+
+#define WATCHDOG_BUCKETS   16    // hist[i]: stalls of [2^(i-1), 2^i) ms
+#define WATCHDOG_RECENT    16
+
+struct watchdog_stall {
+   uint64_t start;               // ns since watchdog_init()
+   uint64_t duration;            // ns
+   const char *handler;
+};
+
+_Atomic(const char*) watchdog_active;
+
+static struct {
+   bool running;
+   pthread_t thread;
+   pthread_mutex_t lock;         // guards everything below 'lock'
+   pthread_cond_t wake;
+   struct wl_event_source *timer;
+   _Atomic uint64_t heartbeat;
+   uint64_t start, period, threshold;
+
+   uint64_t stalls, max_ns;
+   uint64_t hist[WATCHDOG_BUCKETS];
+   struct watchdog_stall recent[WATCHDOG_RECENT];
+} wd = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+static uint64_t
+now_ns()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//--- Backtrace of the main thread ---------------------------------------
+#ifdef HAVE_EXECINFO
+#define BACKTRACE_SIGNAL   SIGURG   // ignored by default, unused by simplewc
+
+static pthread_t main_thread;
+static atomic_int backtrace_fd = -1;   // owned by whoever takes it out first
+static atomic_bool backtrace_done;
+
+static void
+backtrace_handler(int sig)
+{
+   int fd = atomic_exchange(&backtrace_fd, -1);
+   if(fd < 0) return;   // the watchdog gave up on us
+
+   void *frames[64];
+   int n = backtrace(frames, LENGTH(frames));
+   backtrace_symbols_fd(frames, n, fd);
+   close(fd);
+   atomic_store(&backtrace_done, true);
+}
+
+static void
+backtrace_setup()
+{
+   main_thread = pthread_self();
+
+   // the first backtrace() loads libgcc, which must not happen in the handler
+   void *frame;
+   backtrace(&frame, 1);
+
+   struct sigaction sa = { .sa_handler = backtrace_handler, .sa_flags = SA_RESTART };
+   sigemptyset(&sa.sa_mask);
+   sigaction(BACKTRACE_SIGNAL, &sa, NULL);
+}
+
+static void
+backtrace_main(const char *handler, uint64_t stalled_ns)
+{
+   // called from the watchdog thread while the main thread is stuck
+   char path[256];
+   snprintf(path, sizeof path, "%s/simplewc-%d.stall", getenv("XDG_RUNTIME_DIR"), getpid());
+   int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+   if(fd < 0) return;
+
+   dprintf(fd, "--- stalled for %llu ms in %s\n", (unsigned long long)(stalled_ns / 1000000), handler);
+   atomic_store(&backtrace_done, false);
+   atomic_store(&backtrace_fd, fd);
+   pthread_kill(main_thread, BACKTRACE_SIGNAL);
+   for(int i=0; i<100 && !atomic_load(&backtrace_done); i++)
+      nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+
+   // the handler closes the fd itself; it is only ours if it never started
+   fd = atomic_exchange(&backtrace_fd, -1);
+   if(fd >= 0) {
+      close(fd);
+      say(WARNING, "Main thread did not answer the backtrace signal");
+   } else {
+      say(WARNING, "Main thread stack written to %s", path);
+   }
+}
+#else
+static void backtrace_setup() { }
+static void
+backtrace_main(const char *handler, uint64_t stalled_ns)
+{
+   say(WARNING, "watchdog_backtrace needs glibc's execinfo.h");
+}
+#endif
+
+//--- Watchdog thread ----------------------------------------------------
+static void
+watchdog_record(uint64_t beat, uint64_t duration, const char *handler)
+{
+   // called with wd.lock held
+   struct watchdog_stall *s = &wd.recent[wd.stalls % WATCHDOG_RECENT];
+   s->start = beat - wd.start;
+   s->duration = duration;
+   s->handler = handler;
+   wd.stalls++;
+   if(duration > wd.max_ns) wd.max_ns = duration;
+
+   uint64_t ms = duration / 1000000;
+   int bucket = ms ? 64 - __builtin_clzll(ms) : 0;
+   wd.hist[MIN(bucket, WATCHDOG_BUCKETS-1)]++;
+}
+
+static void*
+watchdog_thread(void *data)
+{
+   bool stalled = false;
+   uint64_t stall_beat = 0;
+   const char *stall_handler = NULL;
+
+   pthread_mutex_lock(&wd.lock);
+   while(wd.running) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      uint64_t ns = deadline.tv_nsec + wd.period;
+      deadline.tv_sec += ns / 1000000000ull;
+      deadline.tv_nsec = ns % 1000000000ull;
+      pthread_cond_timedwait(&wd.wake, &wd.lock, &deadline);
+      if(!wd.running) break;
+
+      uint64_t now = now_ns();
+      uint64_t beat = atomic_load(&wd.heartbeat);
+
+      if(!stalled && now - beat > wd.threshold) {
+         // the timer is overdue: whatever is active now is what blocks the loop
+         stalled = true;
+         stall_beat = beat;
+         stall_handler = atomic_load_explicit(&watchdog_active, memory_order_relaxed);
+         if(!stall_handler) stall_handler = "(unknown)";
+
+         pthread_mutex_unlock(&wd.lock);
+         say(WARNING, "Event loop stalled for %llu ms in %s",
+               (unsigned long long)((now - beat) / 1000000), stall_handler);
+         if(g_config->watchdog_backtrace) backtrace_main(stall_handler, now - beat);
+         pthread_mutex_lock(&wd.lock);
+      } else if(stalled && beat != stall_beat) {
+         // the timer should have fired one period after stall_beat
+         uint64_t duration = beat - stall_beat - MIN(wd.period, beat - stall_beat);
+         watchdog_record(stall_beat, duration, stall_handler);
+         stalled = false;
+
+         pthread_mutex_unlock(&wd.lock);
+         say(WARNING, "Event loop resumed after a %llu ms stall in %s",
+               (unsigned long long)(duration / 1000000), stall_handler);
+         pthread_mutex_lock(&wd.lock);
+      }
+   }
+   pthread_mutex_unlock(&wd.lock);
+   return NULL;
+}
+
+static int
+heartbeat_notify(void *data)
+{
+   atomic_store(&wd.heartbeat, now_ns());
+   wl_event_source_timer_update(wd.timer, wd.period / 1000000);
+   return 0;
+}
+
+//------------------------------------------------------------------------
+void
+watchdog_init()
+{
+   if(g_config->watchdog_threshold <= 0) return;
+
+   wd.threshold = (uint64_t)g_config->watchdog_threshold * 1000000;
+   wd.period = MAX(wd.threshold / 4, 10000000ull);
+   wd.start = now_ns();
+   atomic_store(&wd.heartbeat, wd.start);
+
+   wd.timer = wl_event_loop_add_timer(g_server->event_loop, heartbeat_notify, NULL);
+   wl_event_source_timer_update(wd.timer, wd.period / 1000000);
+   if(g_config->watchdog_backtrace) backtrace_setup();
+
+   pthread_condattr_t attr;
+   pthread_condattr_init(&attr);
+   pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+   pthread_cond_init(&wd.wake, &attr);
+   pthread_condattr_destroy(&attr);
+
+   // the watchdog must not take signals meant for the compositor
+   sigset_t all, old;
+   sigfillset(&all);
+   pthread_sigmask(SIG_SETMASK, &all, &old);
+   wd.running = true;
+   if(pthread_create(&wd.thread, NULL, watchdog_thread, NULL)) {
+      wd.running = false;
+      say(WARNING, "Unable to start the watchdog thread");
+   }
+   pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+void
+watchdog_finish()
+{
+   if(wd.timer) wl_event_source_remove(wd.timer);
+   wd.timer = NULL;
+   if(!wd.running) return;
+
+   pthread_mutex_lock(&wd.lock);
+   wd.running = false;
+   pthread_cond_signal(&wd.wake);
+   pthread_mutex_unlock(&wd.lock);
+   pthread_join(wd.thread, NULL);
+}
+
+void
+watchdog_report(FILE *f)
+{
+   if(!wd.threshold) {
+      fprintf(f, "watchdog disabled (watchdog_threshold = 0)\n");
+      return;
+   }
+
+   pthread_mutex_lock(&wd.lock);
+   fprintf(f, "threshold %llu ms, %llu stalls, longest %.1f ms\n", (unsigned long long)(wd.threshold / 1000000),
+         (unsigned long long)wd.stalls, wd.max_ns / 1e6);
+
+   fprintf(f, "\nhistogram (stall < ms: count)\n");
+   for(int b=0; b<WATCHDOG_BUCKETS; b++) {
+      if(wd.hist[b]) fprintf(f, "%8llu: %llu\n", 1ull << b, (unsigned long long)wd.hist[b]);
+   }
+
+   fprintf(f, "\nrecent stalls (s since start, ms, handler)\n");
+   uint64_t first = wd.stalls > WATCHDOG_RECENT ? wd.stalls - WATCHDOG_RECENT : 0;
+   for(uint64_t i=first; i<wd.stalls; i++) {
+      struct watchdog_stall *s = &wd.recent[i % WATCHDOG_RECENT];
+      fprintf(f, "%10.3f %10.1f  %s\n", s->start / 1e9, s->duration / 1e6, s->handler);
+   }
+   pthread_mutex_unlock(&wd.lock);
+}
@@ -0,0 +1,190 @@
+/*
+ * worker.c
+ *   - Worker thread pool
+ *
+ * Jobs wait in a FIFO for the next free worker. Finished jobs go onto a completion
+ * list and the event loop is woken through an eventfd, so done() always runs on
+ * the main thread, in the order the jobs finished.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+
+#include "globals.h"
+#include "server.h"
+#include "worker.h"
+
+#define WORKER_MAX_THREADS 4
+
+struct worker_job {
+   worker_func_t run, done;
+   void *data;
+   struct worker_job *next;
+};
+
+struct job_queue {
+   struct worker_job *head, *tail;
+};
+
+static struct {
+   pthread_mutex_t lock;         // guards both queues and 'running'
+   pthread_cond_t wake;
+   struct job_queue pending, finished;
+   bool running;
+
+   pthread_t threads[WORKER_MAX_THREADS];
+   int n_threads;
+   int done_fd;
+   struct wl_event_source *done_source;
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .done_fd = -1 };
+
+static void
+queue_push(struct job_queue *q, struct worker_job *job)
+{
+   job->next = NULL;
+   if(q->tail) q->tail->next = job;
+   else        q->head = job;
+   q->tail = job;
+}
+
+static struct worker_job*
+queue_pop(struct job_queue *q)
+{
+   struct worker_job *job = q->head;
+   if(job && !(q->head = job->next)) q->tail = NULL;
+   return job;
+}
+
+static void
+queue_done(struct job_queue *q)
+{
+   struct worker_job *job;
+   while((job = queue_pop(q))) {
+      if(job->done) job->done(job->data);
+      free(job);
+   }
+}
+
+static void*
+worker_thread(void *data)
+{
+   pthread_mutex_lock(&pool.lock);
+   for(;;) {
+      struct worker_job *job = NULL;
+      while(pool.running && !(job = queue_pop(&pool.pending)))
+         pthread_cond_wait(&pool.wake, &pool.lock);
+      if(!pool.running) break;
+
+      pthread_mutex_unlock(&pool.lock);
+      job->run(job->data);
+      pthread_mutex_lock(&pool.lock);
+
+      queue_push(&pool.finished, job);
+      eventfd_write(pool.done_fd, 1);
+   }
+   pthread_mutex_unlock(&pool.lock);
+   return NULL;
+}
+
+static int
+worker_done_notify(int fd, uint32_t mask, void *data)
+{
+   eventfd_t count;
+   eventfd_read(fd, &count);
+
+   pthread_mutex_lock(&pool.lock);
+   struct job_queue finished = pool.finished;
+   pool.finished = (struct job_queue){ 0 };
+   pthread_mutex_unlock(&pool.lock);
+
+   queue_done(&finished);
+   return 0;
+}
+
+//------------------------------------------------------------------------
+void
+worker_submit(worker_func_t run, worker_func_t done, void *data)
+{
+   struct worker_job *job = calloc(1, sizeof(struct worker_job));
+   job->run = run;
+   job->done = done;
+   job->data = data;
+
+   pthread_mutex_lock(&pool.lock);
+   bool running = pool.running;
+   if(running) {
+      queue_push(&pool.pending, job);
+      pthread_cond_signal(&pool.wake);
+   }
+   pthread_mutex_unlock(&pool.lock);
+
+   if(!running) {
+      // no pool (yet or any more): run it here, done() still comes from the event loop
+      free(job);
+      run(data);
+      if(done) wl_event_loop_add_idle(g_server->event_loop, done, data);
+   }
+}
+
+void
+worker_init()
+{
+   if((pool.done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+      say(WARNING, "Unable to create the worker eventfd, running jobs on the main thread");
+      return;
+   }
+   pool.done_source = wl_event_loop_add_fd(g_server->event_loop, pool.done_fd, WL_EVENT_READABLE,
+         worker_done_notify, NULL);
+
+   long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+   int n = MAX(1, MIN(WORKER_MAX_THREADS, cpus - 1));
+
+   // workers must not take signals meant for the compositor, but a fault on a
+   // worker (xkbcommon, cairo) still has to reach the flight recorder's handler
+   sigset_t all, old;
+   sigfillset(&all);
+   sigdelset(&all, SIGSEGV);
+   sigdelset(&all, SIGBUS);
+   sigdelset(&all, SIGFPE);
+   sigdelset(&all, SIGILL);
+   sigdelset(&all, SIGABRT);
+   pthread_sigmask(SIG_SETMASK, &all, &old);
+   pool.running = true;
+   for(pool.n_threads=0; pool.n_threads<n; pool.n_threads++) {
+      if(pthread_create(&pool.threads[pool.n_threads], NULL, worker_thread, NULL)) break;
+   }
+   pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+   if(!pool.n_threads) {
+      pool.running = false;
+      say(WARNING, "Unable to start worker threads, running jobs on the main thread");
+   }
+}
+
+void
+worker_finish()
+{
+   pthread_mutex_lock(&pool.lock);
+   pool.running = false;
+   pthread_cond_broadcast(&pool.wake);
+   pthread_mutex_unlock(&pool.lock);
+
+   // workers finish the job they are running; queued jobs are run here, so
+   // every job is reported and done() releases its data
+   for(int i=0; i<pool.n_threads; i++)
+      pthread_join(pool.threads[i], NULL);
+   pool.n_threads = 0;
+
+   struct worker_job *job;
+   while((job = queue_pop(&pool.pending))) {
+      job->run(job->data);
+      queue_push(&pool.finished, job);
+   }
+   queue_done(&pool.finished);
+
+   if(pool.done_source) wl_event_source_remove(pool.done_source);
+   pool.done_source = NULL;
+   if(pool.done_fd >= 0) close(pool.done_fd);
+   pool.done_fd = -1;
+}
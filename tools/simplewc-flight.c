@@ -0,0 +1,120 @@
+/*
+ * simplewc-flight.c
+ *   - Decoder for simplewc flight recorder dumps
+ *
+ * Usage: simplewc-flight $XDG_RUNTIME_DIR/simplewc-<pid>.flight
+ * Times are printed relative to the moment the dump was written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flight.h"
+
+#define LENGTH(X) (sizeof(X) / sizeof((X)[0]))
+
+// enum KeyFunctions in globals.h
+static const char *key_functions[] = { "SPAWN", "QUIT", "LOCK", "TAG", "CLIENT" };
+
+static const char *type_names[FL_NTYPES] = {
+   [FL_NONE]          = "none",
+   [FL_KEY]           = "key",
+   [FL_BUTTON]        = "button",
+   [FL_FOCUS]         = "focus",
+   [FL_MAP]           = "map",
+   [FL_UNMAP]         = "unmap",
+   [FL_CONFIGURE]     = "configure",
+   [FL_COMMIT]        = "commit",
+   [FL_OUTPUT_ADD]    = "output_add",
+   [FL_OUTPUT_REMOVE] = "output_remove",
+   [FL_OUTPUT_LAYOUT] = "output_layout",
+   [FL_IPC]           = "ipc",
+   [FL_ERROR]         = "error",
+   [FL_SIGNAL]        = "signal",
+};
+
+static void
+print_record(const struct flight_record *r, uint64_t dump_ts)
+{
+   char name[sizeof(r->name) + 1] = {0};
+   memcpy(name, r->name, sizeof(r->name));
+
+   printf("%12.6f s  %-14s", ((double)r->ts - (double)dump_ts) / 1e9,
+         r->type < FL_NTYPES ? type_names[r->type] : "?");
+
+   switch(r->type) {
+      case FL_KEY:
+         if(r->a) printf("binding %-7s %s", r->a <= LENGTH(key_functions) ? key_functions[r->a - 1] : "?",
+               r->b ? "pressed" : "released");
+         else     printf("%s", r->b ? "pressed" : "released");
+         break;
+      case FL_BUTTON:
+         printf("button 0x%x %s", r->a, r->b ? "pressed" : "released");
+         break;
+      case FL_FOCUS:
+      case FL_UNMAP:
+         printf("pid %u", r->id);
+         break;
+      case FL_MAP:
+         printf("pid %-7u type %u", r->id, r->a);
+         break;
+      case FL_CONFIGURE:
+         printf("pid %-7u serial %u size %ux%u", r->id, r->a, r->b >> 16, r->b & 0xffff);
+         break;
+      case FL_COMMIT:
+         printf("pid %-7u serial %u", r->id, r->a);
+         break;
+      case FL_OUTPUT_ADD:
+      case FL_OUTPUT_REMOVE:
+         printf("%s", name);
+         break;
+      case FL_OUTPUT_LAYOUT:
+         printf("%-8s %ux%u+%d+%d", name, r->a >> 16, r->a & 0xffff, (int16_t)(r->b >> 16), (int16_t)(r->b & 0xffff));
+         break;
+      case FL_IPC:
+         printf("%-8s 0x%x 0x%x", name, r->a, r->b);
+         break;
+      case FL_SIGNAL:
+         printf("signal %u (%s)", r->a, strsignal(r->a));
+         break;
+   }
+   printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+   if(argc != 2) {
+      fprintf(stderr, "Usage: simplewc-flight file\n");
+      return EXIT_FAILURE;
+   }
+
+   FILE *f = fopen(argv[1], "rb");
+   if(!f) {
+      perror(argv[1]);
+      return EXIT_FAILURE;
+   }
+
+   struct flight_header header;
+   if(fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, FLIGHT_MAGIC, sizeof(header.magic))) {
+      fprintf(stderr, "%s: not a simplewc flight recorder dump\n", argv[1]);
+      return EXIT_FAILURE;
+   }
+   if(header.record_size != sizeof(struct flight_record)) {
+      fprintf(stderr, "%s: record size %u, expected %zu (built from a different version?)\n",
+            argv[1], header.record_size, sizeof(struct flight_record));
+      return EXIT_FAILURE;
+   }
+
+   printf("simplewc pid %d, %u records", header.pid, header.n_records);
+   if(header.signal) printf(", crashed with signal %d (%s)", header.signal, strsignal(header.signal));
+   printf("\n");
+
+   struct flight_record r;
+   for(uint32_t i=0; i<header.n_records && fread(&r, sizeof(r), 1, f) == 1; i++)
+      print_record(&r, header.dump_ts);
+
+   fclose(f);
+   return EXIT_SUCCESS;
+}